@@ -0,0 +1,162 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <random>
+
+#include "cmdline.h"
+#include "common.hpp"
+
+namespace {
+
+using namespace poplar;
+
+using value_type = uint32_t;
+constexpr uint32_t key_bytes = 16;
+using key_type = std::array<uint8_t, key_bytes>;
+
+// Generates random keys whose bytes are 0x00 or 0xFF, which are escaped into two bytes, with the given
+// probability, and otherwise bytes kept as they are. The duplicates are removed.
+std::vector<key_type> make_keys(uint64_t num_keys, double escape_rate, uint64_t seed) {
+    std::mt19937_64 engine{seed};
+    std::bernoulli_distribution escape_dist{escape_rate};
+    std::uniform_int_distribution<uint32_t> byte_dist{1, binary_key_map<plain_bonsai_map<int>, 1>::escape_byte - 1};
+
+    std::vector<key_type> keys(num_keys);
+    for (key_type& key : keys) {
+        for (uint8_t& b : key) {
+            if (escape_dist(engine)) {
+                b = engine() & 1 ? 0x00 : 0xFF;
+            } else {
+                b = static_cast<uint8_t>(byte_dist(engine));
+            }
+        }
+    }
+
+    // Dense bytes make duplicates.
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), engine);
+    return keys;
+}
+
+template <class Map>
+void bench(uint64_t num_keys, double escape_rate, int runs) {
+    const auto keys = make_keys(num_keys, escape_rate, 13);
+
+    // The keys are passed as they are to the maps of fixed-length keys.
+    uint64_t encoded_bytes = 0;
+    for (const key_type& key : keys) {
+        for (uint8_t b : key) {
+            encoded_bytes += binary_key_map<Map, key_bytes>::escapes and (b == 0x00 or b == 0xFF) ? 2 : 1;
+        }
+    }
+
+    uint64_t alloc_bytes = 0;
+    double insert_us_per_key = std::numeric_limits<double>::max();
+    double search_us_per_key = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < runs; ++i) {
+        binary_key_map<Map, key_bytes> map;
+        {
+            timer t;
+            for (uint64_t j = 0; j < keys.size(); ++j) {
+                *map.update(keys[j]) = static_cast<value_type>(j);
+            }
+            insert_us_per_key = std::min(insert_us_per_key, t.get<std::micro>() / keys.size());
+        }
+        {
+            timer t;
+            for (uint64_t j = 0; j < keys.size(); ++j) {
+                auto ptr = map.find(keys[j]);
+                if (ptr == nullptr or *ptr != j) {
+                    std::cerr << "critical error for search results" << std::endl;
+                    std::exit(1);
+                }
+            }
+            search_us_per_key = std::min(search_us_per_key, t.get<std::micro>() / keys.size());
+        }
+        alloc_bytes = map.alloc_bytes();
+    }
+
+    std::cout << escape_rate << '\t' << keys.size() << '\t' << double(encoded_bytes) / keys.size() << '\t'
+              << alloc_bytes << '\t' << double(alloc_bytes) / keys.size() << '\t' << insert_us_per_key << '\t'
+              << search_us_per_key << std::endl;
+}
+
+template <class Map>
+void bench_rates(uint64_t num_keys, int runs) {
+    std::cout << "escape_rate\tnum_keys\tencoded_bytes_per_key\talloc_bytes\tbytes_per_key\tinsert_us_per_key\t"
+                 "search_us_per_key"
+              << std::endl;
+    for (double escape_rate : {0.0, 0.125, 0.25, 0.5, 0.75, 0.875}) {
+        bench<Map>(num_keys, escape_rate, runs);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+
+    cmdline::parser p;
+    p.add<std::string>("map_type", 't', "pbm | cbm | pfkm | cfkm | ffkm", false, "cbm");
+    p.add<uint64_t>("num_keys", 'n', "# of random keys of 16 bytes", false, 1000000);
+    p.add<int>("runs", 'r', "# of runs", false, 3);
+    p.parse_check(argc, argv);
+
+    auto map_type = p.get<std::string>("map_type");
+    auto num_keys = p.get<uint64_t>("num_keys");
+    auto runs = std::max(1, p.get<int>("runs"));
+
+    try {
+        if (map_type == "pbm") {
+            bench_rates<plain_bonsai_map<value_type>>(num_keys, runs);
+            return 0;
+        }
+        if (map_type == "cbm") {
+            bench_rates<compact_bonsai_map<value_type>>(num_keys, runs);
+            return 0;
+        }
+        if (map_type == "pfkm") {
+            bench_rates<plain_fkhash_map<value_type>>(num_keys, runs);
+            return 0;
+        }
+        if (map_type == "cfkm") {
+            bench_rates<compact_fkhash_map<value_type>>(num_keys, runs);
+            return 0;
+        }
+        if (map_type == "ffkm") {
+            bench_rates<fixed_fkhash_map<value_type, key_bytes>>(num_keys, runs);
+            return 0;
+        }
+    } catch (const exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    std::cerr << p.usage() << std::endl;
+    return 1;
+}
@@ -55,6 +55,7 @@ int bench(const cmdline::parser& p) {
     auto query_fn = p.get<std::string>("query_fn");
     auto capa_bits = p.get<uint32_t>("capa_bits");
     auto lambda = p.get<uint64_t>("lambda");
+    auto cache_bits = p.get<uint32_t>("cache_bits");
     auto runs = p.get<int>("runs");
     auto detail = p.get<bool>("detail");
 
@@ -62,7 +63,7 @@ int bench(const cmdline::parser& p) {
     uint64_t ok = 0, ng = 0;
     uint64_t process_size = get_process_size();
 
-    double insert_us_per_key = 0.0, search_us_per_query = 0.0;
+    double insert_us_per_key = 0.0, search_us_per_query = 0.0, cache_hit_rate = 0.0;
     double best_insert_us_per_key = 0.0, best_search_us_per_query = 0.0;
 
     auto map = std::make_unique<Map>(capa_bits, lambda);
@@ -136,6 +137,9 @@ int bench(const cmdline::parser& p) {
 
             // retrieval
             size_t _ok = 0, _ng = 0;
+            if (cache_bits != 0) {
+                map->enable_cache(cache_bits);
+            }
             {
                 timer t;
                 for (const std::string& query : *queries) {
@@ -158,6 +162,7 @@ int bench(const cmdline::parser& p) {
 
             ok = _ok;
             ng = _ng;
+            cache_hit_rate = map->get_cache().hit_rate();
         }
 
         num_keys = keys->size();
@@ -188,6 +193,11 @@ int bench(const cmdline::parser& p) {
     show_stat(out, indent, "search_us_per_query", search_us_per_query);
     show_stat(out, indent, "best_search_us_per_query", best_search_us_per_query);
 
+    if (cache_bits != 0) {
+        show_stat(out, indent, "cache_bits", cache_bits);
+        show_stat(out, indent, "cache_hit_rate", cache_hit_rate);
+    }
+
     show_stat(out, indent, "ok", ok);
     show_stat(out, indent, "ng", ng);
 
@@ -199,6 +209,39 @@ int bench(const cmdline::parser& p) {
     return 0;
 }
 
+template <template <typename, uint64_t, typename> class Map, typename LengthCoder>
+int bench_chunk_sizes(const cmdline::parser& p) {
+    switch (p.get<uint32_t>("chunk_size")) {
+        case 8:
+            return bench<Map<value_type, 8, LengthCoder>>(p);
+        case 16:
+            return bench<Map<value_type, 16, LengthCoder>>(p);
+        case 32:
+            return bench<Map<value_type, 32, LengthCoder>>(p);
+        case 64:
+            return bench<Map<value_type, 64, LengthCoder>>(p);
+        default:
+            std::cerr << p.usage() << std::endl;
+            return 1;
+    }
+}
+
+template <template <typename, uint64_t, typename> class Map>
+int bench_compact(const cmdline::parser& p) {
+    auto length_coder = p.get<std::string>("length_coder");
+    if (length_coder == "vbyte") {
+        return bench_chunk_sizes<Map, vbyte_length_coder>(p);
+    }
+    if (length_coder == "nibble") {
+        return bench_chunk_sizes<Map, nibble_length_coder>(p);
+    }
+    if (length_coder == "fixed") {
+        return bench_chunk_sizes<Map, fixed_length_coder>(p);
+    }
+    std::cerr << p.usage() << std::endl;
+    return 1;
+}
+
 }  // namespace
 
 int main(int argc, char* argv[]) {
@@ -209,81 +252,35 @@ int main(int argc, char* argv[]) {
     p.add<std::string>("query_fn", 'q', "input file name of queries", false, "-");
     p.add<std::string>("map_type", 't', "pbm | scbm | cbm | pfkm | scfkm | cfkm", true);
     p.add<uint32_t>("chunk_size", 'c', "8 | 16 | 32 | 64 (for scbm, cbm, scfkm and cfkm)", false, 16);
+    p.add<std::string>("length_coder", 'e', "vbyte | nibble | fixed (for scbm, cbm, scfkm and cfkm)", false,
+                       "vbyte");
     p.add<uint32_t>("capa_bits", 'b', "#bits of initial capacity", false, 16);
     p.add<uint64_t>("lambda", 'l', "lambda", false, 32);
+    p.add<uint32_t>("cache_bits", 'f', "log2 of #sets of the front cache (0 means no cache)", false, 0);
     p.add<int>("runs", 'r', "# of runs", false, 10);
     p.add<bool>("detail", 'd', "show detail stats?", false, false);
     p.parse_check(argc, argv);
 
     auto map_type = p.get<std::string>("map_type");
-    auto chunk_size = p.get<uint32_t>("chunk_size");
 
     try {
         if (map_type == "pbm") {
             return bench<plain_bonsai_map<value_type>>(p);
         }
         if (map_type == "scbm") {
-            switch (chunk_size) {
-                case 8:
-                    return bench<semi_compact_bonsai_map<value_type, 8>>(p);
-                case 16:
-                    return bench<semi_compact_bonsai_map<value_type, 16>>(p);
-                case 32:
-                    return bench<semi_compact_bonsai_map<value_type, 32>>(p);
-                case 64:
-                    return bench<semi_compact_bonsai_map<value_type, 64>>(p);
-                default:
-                    std::cerr << p.usage() << std::endl;
-                    return 1;
-            }
+            return bench_compact<semi_compact_bonsai_map>(p);
         }
         if (map_type == "cbm") {
-            switch (chunk_size) {
-                case 8:
-                    return bench<compact_bonsai_map<value_type, 8>>(p);
-                case 16:
-                    return bench<compact_bonsai_map<value_type, 16>>(p);
-                case 32:
-                    return bench<compact_bonsai_map<value_type, 32>>(p);
-                case 64:
-                    return bench<compact_bonsai_map<value_type, 64>>(p);
-                default:
-                    std::cerr << p.usage() << std::endl;
-                    return 1;
-            }
+            return bench_compact<compact_bonsai_map>(p);
         }
         if (map_type == "pfkm") {
             return bench<plain_fkhash_map<value_type>>(p);
         }
         if (map_type == "scfkm") {
-            switch (chunk_size) {
-                case 8:
-                    return bench<semi_compact_fkhash_map<value_type, 8>>(p);
-                case 16:
-                    return bench<semi_compact_fkhash_map<value_type, 16>>(p);
-                case 32:
-                    return bench<semi_compact_fkhash_map<value_type, 32>>(p);
-                case 64:
-                    return bench<semi_compact_fkhash_map<value_type, 64>>(p);
-                default:
-                    std::cerr << p.usage() << std::endl;
-                    return 1;
-            }
+            return bench_compact<semi_compact_fkhash_map>(p);
         }
         if (map_type == "cfkm") {
-            switch (chunk_size) {
-                case 8:
-                    return bench<compact_fkhash_map<value_type, 8>>(p);
-                case 16:
-                    return bench<compact_fkhash_map<value_type, 16>>(p);
-                case 32:
-                    return bench<compact_fkhash_map<value_type, 32>>(p);
-                case 64:
-                    return bench<compact_fkhash_map<value_type, 64>>(p);
-                default:
-                    std::cerr << p.usage() << std::endl;
-                    return 1;
-            }
+            return bench_compact<compact_fkhash_map>(p);
         }
     } catch (const exception& ex) {
         std::cerr << ex.what() << std::endl;
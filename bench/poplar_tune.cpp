@@ -0,0 +1,287 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+#include "cmdline.h"
+#include "common.hpp"
+
+namespace {
+
+using namespace poplar;
+
+using value_type = int;
+
+// Measurements of a configuration on the sample.
+struct result {
+    std::string name;
+    uint64_t lambda = 0;
+    uint64_t alloc_bytes = 0;
+    double insert_us_per_key = 0.0;
+    double search_us_per_query = 0.0;
+    bool pareto = false;
+};
+
+struct config {
+    std::vector<std::string> keys;
+    std::vector<std::string> queries;
+    std::vector<uint64_t> lambdas;
+    std::vector<std::string> chunk_sizes;
+    std::vector<std::string> length_coders;
+    int runs = 0;
+    std::vector<result> results;
+};
+
+std::vector<std::string> split(const std::string& str) {
+    std::vector<std::string> items;
+    std::istringstream iss{str};
+    for (std::string item; std::getline(iss, item, ',');) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool contains(const std::vector<std::string>& items, const std::string& item) {
+    return std::find(items.begin(), items.end(), item) != items.end();
+}
+
+// Builds the map of the keys runs times for each lambda, and keeps the best times.
+template <class Map>
+void measure(const std::string& name, config& conf) {
+    for (uint64_t lambda : conf.lambdas) {
+        result res;
+        res.name = name;
+        res.lambda = lambda;
+        res.insert_us_per_key = std::numeric_limits<double>::max();
+        res.search_us_per_query = std::numeric_limits<double>::max();
+
+        uint64_t ok = 0;
+        for (int i = 0; i < conf.runs; ++i) {
+            auto map = std::make_unique<Map>(0, lambda);
+            {
+                timer t;
+                for (const std::string& key : conf.keys) {
+                    *map->update(key) = 1;
+                }
+                res.insert_us_per_key = std::min(res.insert_us_per_key, t.get<std::micro>() / conf.keys.size());
+            }
+
+            uint64_t _ok = 0;
+            {
+                timer t;
+                for (const std::string& query : conf.queries) {
+                    auto ptr = map->find(query);
+                    if (ptr != nullptr and *ptr == 1) {
+                        ++_ok;
+                    }
+                }
+                res.search_us_per_query = std::min(res.search_us_per_query, t.get<std::micro>() / conf.queries.size());
+            }
+
+            if (i != 0 and (ok != _ok or res.alloc_bytes != map->alloc_bytes())) {
+                std::cerr << "critical error for search results or alloc_bytes" << std::endl;
+                std::exit(1);
+            }
+            ok = _ok;
+            res.alloc_bytes = map->alloc_bytes();
+        }
+
+        std::cerr << "measured " << name << " (lambda = " << lambda << ")" << std::endl;
+        conf.results.push_back(res);
+    }
+}
+
+template <template <typename, uint64_t, typename> class Map, typename LengthCoder>
+void measure_chunk_sizes(const std::string& name, config& conf) {
+    const std::string suffix = std::string{"/"} + LengthCoder::name;
+    if (contains(conf.chunk_sizes, "8")) {
+        measure<Map<value_type, 8, LengthCoder>>(name + "/8" + suffix, conf);
+    }
+    if (contains(conf.chunk_sizes, "16")) {
+        measure<Map<value_type, 16, LengthCoder>>(name + "/16" + suffix, conf);
+    }
+    if (contains(conf.chunk_sizes, "32")) {
+        measure<Map<value_type, 32, LengthCoder>>(name + "/32" + suffix, conf);
+    }
+    if (contains(conf.chunk_sizes, "64")) {
+        measure<Map<value_type, 64, LengthCoder>>(name + "/64" + suffix, conf);
+    }
+}
+
+template <template <typename, uint64_t, typename> class Map>
+void measure_compact(const std::string& name, config& conf) {
+    if (contains(conf.length_coders, "vbyte")) {
+        measure_chunk_sizes<Map, vbyte_length_coder>(name, conf);
+    }
+    if (contains(conf.length_coders, "nibble")) {
+        measure_chunk_sizes<Map, nibble_length_coder>(name, conf);
+    }
+    if (contains(conf.length_coders, "fixed")) {
+        measure_chunk_sizes<Map, fixed_length_coder>(name, conf);
+    }
+}
+
+// A configuration is on the Pareto frontier if no other one is as good in all of the memory, the insertion
+// time and the search time, and better in one of them.
+void mark_pareto(std::vector<result>& results) {
+    auto dominates = [](const result& a, const result& b) {
+        const bool no_worse = a.alloc_bytes <= b.alloc_bytes and a.insert_us_per_key <= b.insert_us_per_key and
+                              a.search_us_per_query <= b.search_us_per_query;
+        const bool better = a.alloc_bytes < b.alloc_bytes or a.insert_us_per_key < b.insert_us_per_key or
+                            a.search_us_per_query < b.search_us_per_query;
+        return no_worse and better;
+    };
+    for (result& res : results) {
+        res.pareto = std::none_of(results.begin(), results.end(), [&](const result& other) {  //
+            return dominates(other, res);
+        });
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+
+    cmdline::parser p;
+    p.add<std::string>("key_fn", 'k', "input file name of sample keywords", true);
+    p.add<std::string>("query_fn", 'q', "input file name of sample queries", false, "-");
+    p.add<std::string>("map_types", 't', "comma-separated list of pbm | scbm | cbm | pfkm | scfkm | cfkm", false,
+                       "pbm,scbm,cbm,pfkm,scfkm,cfkm");
+    p.add<std::string>("chunk_sizes", 'c', "comma-separated list of 8 | 16 | 32 | 64 (for scbm, cbm, scfkm and cfkm)",
+                       false, "8,16,32,64");
+    p.add<std::string>("length_coders", 'e',
+                       "comma-separated list of vbyte | nibble | fixed (for scbm, cbm, scfkm and cfkm)", false,
+                       "vbyte");
+    p.add<std::string>("lambdas", 'l', "comma-separated list of lambdas", false, "8,32,128");
+    p.add<double>("budget", 'm',
+                  "memory budget in bytes per key (0 means no budget); with only the budget, the fastest "
+                  "configuration within it is recommended",
+                  false, 0.0);
+    p.add<double>("latency", 'u',
+                  "target search time in microseconds per query (0 means no target); with the target, or with "
+                  "neither the target nor the budget, the smallest configuration on the Pareto frontier within "
+                  "the constraints is recommended",
+                  false, 0.0);
+    p.add<int>("runs", 'r', "# of runs", false, 3);
+    p.parse_check(argc, argv);
+
+    auto key_fn = p.get<std::string>("key_fn");
+    auto query_fn = p.get<std::string>("query_fn");
+    auto map_types = split(p.get<std::string>("map_types"));
+    auto budget = p.get<double>("budget");
+    auto latency = p.get<double>("latency");
+
+    config conf;
+    conf.keys = load_keys(key_fn.c_str());
+    conf.queries = query_fn != "-" ? load_keys(query_fn.c_str()) : conf.keys;
+    conf.chunk_sizes = split(p.get<std::string>("chunk_sizes"));
+    conf.length_coders = split(p.get<std::string>("length_coders"));
+    conf.runs = std::max(1, p.get<int>("runs"));
+    for (const std::string& lambda : split(p.get<std::string>("lambdas"))) {
+        conf.lambdas.push_back(std::stoull(lambda));
+    }
+
+    if (conf.keys.empty() or conf.queries.empty() or conf.lambdas.empty()) {
+        std::cerr << p.usage() << std::endl;
+        return 1;
+    }
+
+    try {
+        for (const std::string& map_type : map_types) {
+            if (map_type == "pbm") {
+                measure<plain_bonsai_map<value_type>>(map_type, conf);
+            } else if (map_type == "scbm") {
+                measure_compact<semi_compact_bonsai_map>(map_type, conf);
+            } else if (map_type == "cbm") {
+                measure_compact<compact_bonsai_map>(map_type, conf);
+            } else if (map_type == "pfkm") {
+                measure<plain_fkhash_map<value_type>>(map_type, conf);
+            } else if (map_type == "scfkm") {
+                measure_compact<semi_compact_fkhash_map>(map_type, conf);
+            } else if (map_type == "cfkm") {
+                measure_compact<compact_fkhash_map>(map_type, conf);
+            } else {
+                std::cerr << p.usage() << std::endl;
+                return 1;
+            }
+        }
+    } catch (const exception& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<result>& results = conf.results;
+    mark_pareto(results);
+    std::sort(results.begin(), results.end(), [](const result& a, const result& b) {  //
+        return a.alloc_bytes < b.alloc_bytes;
+    });
+
+    const double num_keys = conf.keys.size();
+
+    std::cout << "map\tlambda\talloc_bytes\tbytes_per_key\tinsert_us_per_key\tsearch_us_per_query\tpareto" << std::endl;
+    for (const result& res : results) {
+        std::cout << res.name << '\t' << res.lambda << '\t' << res.alloc_bytes << '\t' << res.alloc_bytes / num_keys
+                  << '\t' << res.insert_us_per_key << '\t' << res.search_us_per_query << '\t'
+                  << (res.pareto ? "yes" : "no") << std::endl;
+    }
+
+    // Among the configurations on the frontier within the constraints, the fastest one is recommended if only the
+    // budget is given; otherwise the smallest one.
+    const result* best = nullptr;
+    for (const result& res : results) {
+        if (!res.pareto or (budget != 0.0 and budget < res.alloc_bytes / num_keys) or
+            (latency != 0.0 and latency < res.search_us_per_query)) {
+            continue;
+        }
+        if (best == nullptr) {
+            best = &res;
+        } else if (budget != 0.0 and latency == 0.0 and res.search_us_per_query < best->search_us_per_query) {
+            best = &res;
+        }
+    }
+
+    std::ostream& out = std::cout;
+    auto indent = get_indent(0);
+
+    show_stat(out, indent, "num_keys", conf.keys.size());
+    show_stat(out, indent, "num_queries", conf.queries.size());
+    show_stat(out, indent, "num_configs", results.size());
+    if (best == nullptr) {
+        show_stat(out, indent, "recommended", "none");
+        return 1;
+    }
+    show_stat(out, indent, "recommended", best->name);
+    show_stat(out, indent, "lambda", best->lambda);
+    show_stat(out, indent, "bytes_per_key", best->alloc_bytes / num_keys);
+    show_stat(out, indent, "insert_us_per_key", best->insert_us_per_key);
+    show_stat(out, indent, "search_us_per_query", best->search_us_per_query);
+
+    return 0;
+}
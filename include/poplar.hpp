@@ -31,30 +31,41 @@
 
 #include "poplar/compact_bonsai_nlm.hpp"
 #include "poplar/compact_fkhash_nlm.hpp"
+#include "poplar/fixed_fkhash_nlm.hpp"
 #include "poplar/plain_bonsai_nlm.hpp"
 #include "poplar/plain_fkhash_nlm.hpp"
+#include "poplar/value_array_nlm.hpp"
 
+#include "poplar/background_map.hpp"
+#include "poplar/binary_key_map.hpp"
+#include "poplar/blob_map.hpp"
+#include "poplar/concurrent_counter.hpp"
 #include "poplar/map.hpp"
+#include "poplar/partitioned_map.hpp"
+#include "poplar/small_map.hpp"
 
 namespace poplar {
 
 template <typename Value>
 using plain_bonsai_map = map<plain_bonsai_trie<>, plain_bonsai_nlm<Value>>;
 
-template <typename Value, uint64_t ChunkSize = 16>
-using semi_compact_bonsai_map = map<plain_bonsai_trie<>, compact_bonsai_nlm<Value, ChunkSize>>;
+template <typename Value, uint64_t ChunkSize = 16, typename LengthCoder = vbyte_length_coder>
+using semi_compact_bonsai_map = map<plain_bonsai_trie<>, compact_bonsai_nlm<Value, ChunkSize, LengthCoder>>;
 
-template <typename Value, uint64_t ChunkSize = 16>
-using compact_bonsai_map = map<compact_bonsai_trie<>, compact_bonsai_nlm<Value, ChunkSize>>;
+template <typename Value, uint64_t ChunkSize = 16, typename LengthCoder = vbyte_length_coder>
+using compact_bonsai_map = map<compact_bonsai_trie<>, compact_bonsai_nlm<Value, ChunkSize, LengthCoder>>;
 
 template <typename Value>
 using plain_fkhash_map = map<plain_fkhash_trie<>, plain_fkhash_nlm<Value>>;
 
-template <typename Value, uint64_t ChunkSize = 16>
-using semi_compact_fkhash_map = map<plain_fkhash_trie<>, compact_fkhash_nlm<Value, ChunkSize>>;
+template <typename Value, uint64_t ChunkSize = 16, typename LengthCoder = vbyte_length_coder>
+using semi_compact_fkhash_map = map<plain_fkhash_trie<>, compact_fkhash_nlm<Value, ChunkSize, LengthCoder>>;
 
-template <typename Value, uint64_t ChunkSize = 16>
-using compact_fkhash_map = map<compact_fkhash_trie<>, compact_fkhash_nlm<Value, ChunkSize>>;
+template <typename Value, uint64_t ChunkSize = 16, typename LengthCoder = vbyte_length_coder>
+using compact_fkhash_map = map<compact_fkhash_trie<>, compact_fkhash_nlm<Value, ChunkSize, LengthCoder>>;
+
+template <typename Value, uint32_t KeyBytes>
+using fixed_fkhash_map = map<compact_fkhash_trie<>, fixed_fkhash_nlm<Value, KeyBytes>>;
 
 }  // namespace poplar
 
@@ -0,0 +1,298 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_BACKGROUND_MAP_HPP
+#define POPLAR_TRIE_BACKGROUND_MAP_HPP
+
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "map.hpp"
+
+namespace poplar {
+
+// This class wraps a map so that the hash table grows on a background thread instead of blocking update().
+// When the table becomes RebuildPercent% full, the next generation of twice the capacity is built from the
+// current one on a worker thread, which keeps serving find(). Meanwhile the updates go to a delta map. When the
+// worker has finished, the delta is frozen and replayed by the worker in the same way while a new delta takes
+// the updates, until the delta is small enough to be replayed by update() before the generations are swapped.
+// find() may be called from any threads, and update() from one thread at a time. The front cache of the
+// wrapped maps must not be enabled since it makes find() unsafe to call concurrently.
+template <typename Map, uint32_t RebuildPercent = 75>
+class background_map {
+    static_assert(0 < RebuildPercent and RebuildPercent < 100);
+
+  public:
+    using this_type = background_map<Map, RebuildPercent>;
+    using map_type = Map;
+    using value_type = typename Map::value_type;
+
+    // The delta is replayed by update() if it has at most max_sync_keys keys or max_rounds deltas have been
+    // frozen, which bounds the rounds when the worker cannot catch up with the updates.
+    static constexpr uint64_t max_sync_keys = 1ULL << 10;
+    static constexpr uint64_t max_rounds = 8;
+
+  public:
+    // Generic constructor.
+    background_map() : background_map(0) {}
+
+    // Class constructor. Initially allocates the hash table of length 2**capa_bits.
+    explicit background_map(uint32_t capa_bits, uint64_t lambda = 32)
+        : cur_{std::make_unique<map_type>(capa_bits, lambda)} {}
+
+    // Waits for the worker.
+    ~background_map() {
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+    // Searches the given key and returns a copy of the value if registered.
+    std::optional<value_type> find(const std::string& key) const {
+        return find(make_char_range(key));
+    }
+    std::optional<value_type> find(char_range key) const {
+        std::shared_lock lock{mutex_};
+        if (auto ptr = find_(key); ptr != nullptr) {
+            return value_type(*ptr);
+        }
+        return std::nullopt;
+    }
+
+    // Sets the value of the given key. Swaps the generations if the worker has finished.
+    void update(const std::string& key, const value_type& value) {
+        update(make_char_range(key), value);
+    }
+    void update(char_range key, const value_type& value) {
+        std::lock_guard writer_lock{writer_mutex_};
+        poll_();
+
+        if (next_) {
+            // The current generation is read by the worker, so the update goes to the delta.
+            // Only the writer modifies the maps, so the key can be searched without the exclusive lock.
+            const bool is_new = find_(key) == nullptr;
+            std::unique_lock lock{mutex_};
+            *deltas_.back()->update(key) = value;
+            size_ += is_new;
+            return;
+        }
+
+        {
+            std::unique_lock lock{mutex_};
+            *cur_->update(key) = value;
+            size_ = cur_->size();
+        }
+        if (RebuildPercent / 100.0 <= cur_->fill_rate()) {
+            start_rebuild_();
+        }
+    }
+
+    // Waits for the running rebuild, if any, and swaps the generations.
+    void wait() {
+        std::lock_guard writer_lock{writer_mutex_};
+        while (next_) {
+            worker_.join();
+            finish_round_();
+        }
+    }
+
+    // Calls fn(key, value) for every registered key in no particular order.
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        std::shared_lock lock{mutex_};
+
+        // A key is given from the newest map that has it.
+        std::string buf;
+        auto enumerate_map = [&](const map_type& m, uint64_t num_newer) {
+            m.enumerate([&](std::string_view key, const value_type& value) {
+                buf.assign(key);
+                for (uint64_t i = deltas_.size() - num_newer; i < deltas_.size(); ++i) {
+                    if (deltas_[i]->find(buf) != nullptr) {
+                        return;
+                    }
+                }
+                fn(key, value);
+            });
+        };
+        for (uint64_t i = deltas_.size(); i > 0; --i) {
+            enumerate_map(*deltas_[i - 1], deltas_.size() - i);
+        }
+        enumerate_map(*cur_, deltas_.size());
+    }
+
+    uint64_t size() const {
+        std::shared_lock lock{mutex_};
+        return size_;
+    }
+    // Gets the number of finished rebuilds.
+    uint64_t num_rebuilds() const {
+        return num_rebuilds_.load(std::memory_order_relaxed);
+    }
+    // Gets whether a rebuild is running.
+    bool is_rebuilding() const {
+        std::lock_guard writer_lock{writer_mutex_};
+        return bool(next_);
+    }
+    // The next generation is not counted while it is built.
+    uint64_t alloc_bytes() const {
+        std::shared_lock lock{mutex_};
+        uint64_t bytes = cur_->alloc_bytes();
+        for (const auto& delta : deltas_) {
+            bytes += delta->alloc_bytes();
+        }
+        return bytes;
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        std::shared_lock lock{mutex_};
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "background_map");
+        show_stat(os, indent, "rebuild_percent", RebuildPercent);
+        show_stat(os, indent, "num_rebuilds", num_rebuilds());
+        show_stat(os, indent, "num_deltas", deltas_.size());
+        show_stat(os, indent, "size", size_);
+        show_member(os, indent, "cur_");
+        cur_->show_stats(os, n + 1);
+    }
+
+    background_map(const background_map&) = delete;
+    background_map& operator=(const background_map&) = delete;
+
+  private:
+    std::unique_ptr<map_type> cur_;
+    std::vector<std::unique_ptr<map_type>> deltas_;  // updates during the rebuild; only the last one is modified
+    std::unique_ptr<map_type> next_;  // being built by the worker
+    uint64_t size_ = 0;
+
+    std::thread worker_;
+    std::atomic<bool> is_built_ = false;
+    std::exception_ptr error_;  // thrown by the worker
+    std::atomic<uint64_t> num_rebuilds_ = 0;
+
+    mutable std::shared_mutex mutex_;  // guards the maps and size_ against the readers
+    mutable std::mutex writer_mutex_;  // serializes the writers
+
+    // Searches the maps from the newest.
+    typename map_type::const_value_pointer find_(char_range key) const {
+        for (uint64_t i = deltas_.size(); i > 0; --i) {
+            if (auto ptr = deltas_[i - 1]->find(key); ptr != nullptr) {
+                return ptr;
+            }
+        }
+        return cur_->find(key);
+    }
+
+    // The followings need the writer lock.
+    void start_rebuild_() {
+        const uint32_t capa_bits = bit_tools::ceil_log2(cur_->capa_size()) + 1;
+        next_ = std::make_unique<map_type>(capa_bits, cur_->lambda());
+        add_delta_();
+        start_worker_(cur_.get());
+    }
+    void add_delta_() {
+        auto delta = std::make_unique<map_type>(0, cur_->lambda());
+        std::unique_lock lock{mutex_};
+        deltas_.push_back(std::move(delta));
+    }
+    // Inserts the pairs of src into next_ on the worker.
+    void start_worker_(const map_type* src) {
+        is_built_.store(false, std::memory_order_relaxed);
+        worker_ = std::thread([this, src] {
+            try {
+                replay_(*src);
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+            is_built_.store(true, std::memory_order_release);
+        });
+    }
+    void poll_() {
+        if (next_ and is_built_.load(std::memory_order_acquire)) {
+            worker_.join();
+            finish_round_();
+        }
+    }
+    void finish_round_() {
+        if (error_) {
+            // The deltas are merged into the current generation, which is no longer read by the worker.
+            next_.reset();
+            {
+                std::unique_lock lock{mutex_};
+                std::string buf;
+                for (const auto& delta : deltas_) {
+                    delta->enumerate([&](std::string_view key, const value_type& value) {
+                        buf.assign(key);
+                        *cur_->update(buf) = value;
+                    });
+                }
+                deltas_.clear();
+                size_ = cur_->size();
+            }
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+
+        const map_type* delta = deltas_.back().get();
+        if (max_sync_keys < delta->size() and deltas_.size() < max_rounds) {
+            // The last delta is frozen and replayed by the worker.
+            add_delta_();
+            start_worker_(delta);
+            return;
+        }
+
+        // The next generation is not visible yet, so the delta is replayed without blocking the readers.
+        replay_(*delta);
+        swap_(next_);
+        num_rebuilds_.fetch_add(1, std::memory_order_relaxed);
+    }
+    void replay_(const map_type& src) {
+        std::string buf;
+        src.enumerate([&](std::string_view key, const value_type& value) {
+            buf.assign(key);
+            *next_->update(buf) = value;
+        });
+    }
+    // Replaces the current generation and the deltas with the given map.
+    void swap_(std::unique_ptr<map_type>& new_cur) {
+        std::unique_ptr<map_type> old_cur;
+        std::vector<std::unique_ptr<map_type>> old_deltas;
+        {
+            std::unique_lock lock{mutex_};
+            old_cur = std::exchange(cur_, std::move(new_cur));
+            old_deltas = std::exchange(deltas_, {});
+            size_ = cur_->size();
+        }
+        // The old maps are released out of the lock.
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_BACKGROUND_MAP_HPP
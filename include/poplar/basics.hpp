@@ -24,13 +24,16 @@
 #ifndef POPLAR_TRIE_BASICS_HPP
 #define POPLAR_TRIE_BASICS_HPP
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <istream>
 #include <limits>
 #include <ostream>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 #include "poplar_config.hpp"
@@ -44,6 +47,13 @@ using std::uint8_t;
 
 enum class trie_type_ids : uint8_t { BONSAI_TRIE, FKHASH_TRIE };
 
+// Value type of the NLMs storing only the labels, whose values are kept elsewhere as in value_array_nlm.
+struct no_value {};
+
+// The bytes of a value stored after each label in the NLMs.
+template <typename Value>
+constexpr uint64_t value_size_v = std::is_same_v<Value, no_value> ? 0 : sizeof(Value);
+
 struct char_range {
     const uint8_t* begin = nullptr;
     const uint8_t* end = nullptr;
@@ -123,6 +133,60 @@ inline void show_stat(std::ostream& os, const std::string& indent, const char* k
     os << indent << k << ':' << v << '\n';
 }
 
+// Serializes trivially copyable objects and vectors of them in the native byte order.
+template <class T>
+inline void save_pod(std::ostream& os, const T& x) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+template <class T>
+inline void load_pod(std::istream& is, T& x) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    is.read(reinterpret_cast<char*>(&x), sizeof(T));
+}
+template <class T>
+inline void save_vec(std::ostream& os, const std::vector<T>& vec) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    save_pod(os, static_cast<uint64_t>(vec.size()));
+    os.write(reinterpret_cast<const char*>(vec.data()), static_cast<std::streamsize>(vec.size() * sizeof(T)));
+}
+// The length read from the stream is not trusted: it is checked against the bytes left in the stream before
+// allocating, or the elements are read in pieces of 1 MiB if the stream cannot tell them. A vector longer than
+// the stream fails the stream and is cleared.
+template <class T>
+inline void load_vec(std::istream& is, std::vector<T>& vec) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint64_t size = 0;
+    load_pod(is, size);
+    vec.clear();
+    if (!is) {
+        return;
+    }
+
+    const std::streampos pos = is.tellg();
+    if (pos != std::streampos(-1)) {
+        is.seekg(0, std::ios::end);
+        const std::streamoff rest = is.tellg() - pos;
+        is.seekg(pos);
+        if (!is or static_cast<uint64_t>(rest) / sizeof(T) < size) {
+            is.setstate(std::ios::failbit);
+            return;
+        }
+    }
+
+    constexpr uint64_t piece_size = std::max<uint64_t>(1, (1ULL << 20) / sizeof(T));
+    while (vec.size() < size) {
+        const uint64_t begin = vec.size();
+        vec.resize(begin + std::min(piece_size, size - begin));
+        const uint64_t bytes = (vec.size() - begin) * sizeof(T);
+        is.read(reinterpret_cast<char*>(vec.data() + begin), static_cast<std::streamsize>(bytes));
+        if (!is) {
+            vec.clear();
+            return;
+        }
+    }
+}
+
 template <uint64_t N>
 struct chunk_type_traits;
 template <>
@@ -24,6 +24,10 @@
 #ifndef POPLAR_TRIE_BIJECTIVE_HASH_HPP
 #define POPLAR_TRIE_BIJECTIVE_HASH_HPP
 
+#if defined(__AVX512DQ__) or defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "basics.hpp"
 
 namespace poplar::bijective_hash {
@@ -106,6 +110,13 @@ class split_mix_hasher {
 
         shift_ = univ_bits / 2 + 1;
         univ_size_ = size_p2{univ_bits};
+
+        // Caches the multipliers so that each round does not index PRIME_TABLE
+        for (uint32_t i = 0; i < 2; ++i) {
+            for (uint32_t j = 0; j < 3; ++j) {
+                primes_[i][j] = PRIME_TABLE[univ_bits][i][j];
+            }
+        }
     }
 
     uint64_t hash(uint64_t x) const {
@@ -124,6 +135,56 @@ class split_mix_hasher {
         return x;
     }
 
+    // Hashes n values of xs into ys at once (xs and ys may be the same array).
+    void hash_n(const uint64_t* xs, uint64_t* ys, uint64_t n) const {
+        uint64_t i = 0;
+#if defined(__AVX512DQ__)
+        for (; i + 8 <= n; i += 8) {
+            __m512i x = _mm512_loadu_si512(xs + i);
+            x = hash_avx512_<0>(x);
+            x = hash_avx512_<1>(x);
+            x = hash_avx512_<2>(x);
+            _mm512_storeu_si512(ys + i, x);
+        }
+#elif defined(__AVX2__)
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs + i));
+            x = hash_avx2_<0>(x);
+            x = hash_avx2_<1>(x);
+            x = hash_avx2_<2>(x);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(ys + i), x);
+        }
+#endif
+        for (; i < n; ++i) {
+            ys[i] = hash(xs[i]);
+        }
+    }
+
+    // Inverts n hash values of xs into ys at once (xs and ys may be the same array).
+    void hash_inv_n(const uint64_t* xs, uint64_t* ys, uint64_t n) const {
+        uint64_t i = 0;
+#if defined(__AVX512DQ__)
+        for (; i + 8 <= n; i += 8) {
+            __m512i x = _mm512_loadu_si512(xs + i);
+            x = hash_inv_avx512_<2>(x);
+            x = hash_inv_avx512_<1>(x);
+            x = hash_inv_avx512_<0>(x);
+            _mm512_storeu_si512(ys + i, x);
+        }
+#elif defined(__AVX2__)
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs + i));
+            x = hash_inv_avx2_<2>(x);
+            x = hash_inv_avx2_<1>(x);
+            x = hash_inv_avx2_<0>(x);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(ys + i), x);
+        }
+#endif
+        for (; i < n; ++i) {
+            ys[i] = hash_inv(xs[i]);
+        }
+    }
+
     uint64_t size() const {
         return univ_size_.size();
     }
@@ -142,20 +203,59 @@ class split_mix_hasher {
   private:
     uint32_t shift_ = 0;
     size_p2 univ_size_;
+    uint64_t primes_[2][3] = {};
 
     template <uint32_t N>
     uint64_t hash_(uint64_t x) const {
         x = x ^ (x >> (shift_ + N));
-        x = (x * PRIME_TABLE[univ_size_.bits()][0][N]) & univ_size_.mask();
+        x = (x * primes_[0][N]) & univ_size_.mask();
         return x;
     }
 
     template <uint32_t N>
     uint64_t hash_inv_(uint64_t x) const {
-        x = (x * PRIME_TABLE[univ_size_.bits()][1][N]) & univ_size_.mask();
+        x = (x * primes_[1][N]) & univ_size_.mask();
         x = x ^ (x >> (shift_ + N));
         return x;
     }
+
+#if defined(__AVX512DQ__)
+    template <uint32_t N>
+    __m512i hash_avx512_(__m512i x) const {
+        x = _mm512_xor_si512(x, _mm512_maskz_srl_epi64(0xFF, x, _mm_cvtsi64_si128(shift_ + N)));
+        x = _mm512_mullo_epi64(x, _mm512_set1_epi64(primes_[0][N]));
+        return _mm512_and_si512(x, _mm512_set1_epi64(univ_size_.mask()));
+    }
+
+    template <uint32_t N>
+    __m512i hash_inv_avx512_(__m512i x) const {
+        x = _mm512_mullo_epi64(x, _mm512_set1_epi64(primes_[1][N]));
+        x = _mm512_and_si512(x, _mm512_set1_epi64(univ_size_.mask()));
+        return _mm512_xor_si512(x, _mm512_maskz_srl_epi64(0xFF, x, _mm_cvtsi64_si128(shift_ + N)));
+    }
+#elif defined(__AVX2__)
+    // AVX2 has no 64-bit multiplication, so it is composed of 32-bit ones.
+    static __m256i mullo_epi64_(__m256i a, __m256i b) {
+        __m256i lo = _mm256_mul_epu32(a, b);
+        __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                         _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+        return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+    }
+
+    template <uint32_t N>
+    __m256i hash_avx2_(__m256i x) const {
+        x = _mm256_xor_si256(x, _mm256_srl_epi64(x, _mm_cvtsi64_si128(shift_ + N)));
+        x = mullo_epi64_(x, _mm256_set1_epi64x(primes_[0][N]));
+        return _mm256_and_si256(x, _mm256_set1_epi64x(univ_size_.mask()));
+    }
+
+    template <uint32_t N>
+    __m256i hash_inv_avx2_(__m256i x) const {
+        x = mullo_epi64_(x, _mm256_set1_epi64x(primes_[1][N]));
+        x = _mm256_and_si256(x, _mm256_set1_epi64x(univ_size_.mask()));
+        return _mm256_xor_si256(x, _mm256_srl_epi64(x, _mm_cvtsi64_si128(shift_ + N)));
+    }
+#endif
 };
 
 }  // namespace poplar::bijective_hash
@@ -0,0 +1,184 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_BINARY_KEY_MAP_HPP
+#define POPLAR_TRIE_BINARY_KEY_MAP_HPP
+
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#include "basics.hpp"
+#include "exception.hpp"
+
+namespace poplar {
+
+// This class implements an associative array whose keys are binary strings of KeyBytes bytes, e.g., 8-byte IDs
+// or 16-byte hashes, which may contain any byte including zero.
+// If Map takes the keys of KeyBytes bytes, as with fixed_fkhash_nlm, the keys are passed as they are: they have
+// no terminator, every byte has its own code, and the labels are stored without lengths.
+// Otherwise, each key is escaped into a null-terminated string of the characters 0x01..0xFD for Map, where a byte
+// b is kept if 0 < b < 0xFD and otherwise replaced by 0xFD followed by 0x01..0x04. Random keys get longer by
+// 4/256 on average, but a key can take up to 2 * KeyBytes + 1 bytes, e.g., if most of its bytes are 0x00 or 0xFF,
+// and the NLM of Map also stores the length of each label. bench/bench_binary_keys compares the two.
+template <typename Map, uint32_t KeyBytes>
+class binary_key_map {
+    static_assert(0 < KeyBytes);
+    static_assert(Map::key_bytes == 0 or Map::key_bytes == KeyBytes);
+
+  public:
+    using this_type = binary_key_map<Map, KeyBytes>;
+    using map_type = Map;
+    using value_type = typename Map::value_type;
+    using value_pointer = typename Map::value_pointer;
+    using const_value_pointer = typename Map::const_value_pointer;
+
+    static constexpr uint32_t key_bytes = KeyBytes;
+    static constexpr bool escapes = Map::key_bytes == 0;
+    static constexpr uint8_t escape_byte = 0xFD;
+
+  public:
+    // Generic constructor.
+    binary_key_map() = default;
+
+    // Class constructor. Initially allocates the hash table of length 2**capa_bits.
+    explicit binary_key_map(uint32_t capa_bits, uint64_t lambda = 32) : map_{capa_bits, lambda} {}
+
+    // Generic destructor.
+    ~binary_key_map() = default;
+
+    // Searches the key of KeyBytes bytes and returns the value pointer if registered;
+    // otherwise returns nullptr.
+    const_value_pointer find(const uint8_t* key) const {
+        uint8_t buf[max_encoded_bytes];
+        return map_.find(encode_(key, buf));
+    }
+    // Same as above for a trivially copyable key of KeyBytes bytes, e.g., uint64_t or std::array<uint8_t, 16>.
+    template <typename Key, typename = std::enable_if_t<!std::is_pointer_v<Key>>>
+    const_value_pointer find(const Key& key) const {
+        static_assert(std::is_trivially_copyable_v<Key> and sizeof(Key) == KeyBytes);
+        return find(reinterpret_cast<const uint8_t*>(&key));
+    }
+
+    // Inserts the key of KeyBytes bytes and returns the value pointer.
+    value_pointer update(const uint8_t* key) {
+        uint8_t buf[max_encoded_bytes];
+        return map_.update(encode_(key, buf));
+    }
+    template <typename Key, typename = std::enable_if_t<!std::is_pointer_v<Key>>>
+    value_pointer update(const Key& key) {
+        static_assert(std::is_trivially_copyable_v<Key> and sizeof(Key) == KeyBytes);
+        return update(reinterpret_cast<const uint8_t*>(&key));
+    }
+
+    // Calls fn(key, value) for every registered key in no particular order, where key is given as
+    // const uint8_t* of KeyBytes bytes.
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        uint8_t key[KeyBytes];
+        map_.enumerate([&](std::string_view encoded, const value_type& value) {  //
+            fn(decode_(encoded, key), value);
+        });
+    }
+    template <typename Fn>
+    void enumerate(Fn fn) {
+        uint8_t key[KeyBytes];
+        map_.enumerate([&](std::string_view encoded, auto&& value) {  //
+            fn(decode_(encoded, key), value);
+        });
+    }
+
+    // Gets the number of registered keys.
+    uint64_t size() const {
+        return map_.size();
+    }
+    const map_type& get_map() const {
+        return map_;
+    }
+    uint64_t alloc_bytes() const {
+        return map_.alloc_bytes();
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "binary_key_map");
+        show_stat(os, indent, "key_bytes", KeyBytes);
+        show_stat(os, indent, "escapes", escapes);
+        show_member(os, indent, "map_");
+        map_.show_stats(os, n + 1);
+    }
+
+    binary_key_map(const binary_key_map&) = delete;
+    binary_key_map& operator=(const binary_key_map&) = delete;
+
+    binary_key_map(binary_key_map&&) noexcept = default;
+    binary_key_map& operator=(binary_key_map&&) noexcept = default;
+
+  private:
+    static constexpr uint32_t max_encoded_bytes = KeyBytes * 2 + 1;
+
+    map_type map_;
+
+    // Escapes the key into buf with the terminator if needed.
+    static char_range encode_(const uint8_t* key, [[maybe_unused]] uint8_t* buf) {
+        if constexpr (!escapes) {
+            return {key, key + KeyBytes};
+        } else {
+            uint8_t* ptr = buf;
+            for (uint32_t i = 0; i < KeyBytes; ++i) {
+                const uint8_t b = key[i];
+                if (b != 0 and b < escape_byte) {
+                    *ptr++ = b;
+                } else {
+                    *ptr++ = escape_byte;
+                    *ptr++ = b == 0 ? 1 : static_cast<uint8_t>(b - escape_byte + 2);
+                }
+            }
+            *ptr++ = '\0';
+            return {buf, ptr};
+        }
+    }
+    static const uint8_t* decode_(std::string_view encoded, [[maybe_unused]] uint8_t* key) {
+        if constexpr (!escapes) {
+            assert(encoded.size() == KeyBytes);
+            return reinterpret_cast<const uint8_t*>(encoded.data());
+        } else {
+            uint32_t i = 0;
+            for (uint64_t j = 0; j < encoded.size(); ++j) {
+                const uint8_t b = static_cast<uint8_t>(encoded[j]);
+                if (b != escape_byte) {
+                    key[i++] = b;
+                } else {
+                    const uint8_t x = static_cast<uint8_t>(encoded[++j]);
+                    key[i++] = x == 1 ? 0 : static_cast<uint8_t>(x + escape_byte - 2);
+                }
+            }
+            assert(i == KeyBytes);
+            return key;
+        }
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_BINARY_KEY_MAP_HPP
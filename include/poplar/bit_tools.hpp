@@ -28,10 +28,35 @@
 #include <xmmintrin.h>
 #endif
 
+#if defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+#include <immintrin.h>
+#define POPLAR_CPU_DISPATCH
+#endif
+
 #include "basics.hpp"
 
 namespace poplar::bit_tools {
 
+// Instruction set extensions detected at runtime, so that a binary built for a baseline target still uses
+// the faster instructions of the running CPU.
+struct cpu_features {
+    bool bmi2 = false;  // excluding AMD Zen 1/2 whose pdep is microcoded and slower than the fallback
+    bool avx512_vpopcntdq = false;
+};
+
+inline const cpu_features& get_cpu_features() {
+    static const cpu_features features = [] {
+        cpu_features f;
+#ifdef POPLAR_CPU_DISPATCH
+        __builtin_cpu_init();
+        f.bmi2 = __builtin_cpu_supports("bmi2") and !__builtin_cpu_is("znver1") and !__builtin_cpu_is("znver2");
+        f.avx512_vpopcntdq = __builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+        return f;
+    }();
+    return features;
+}
+
 // Gets a bit
 inline bool get_bit(uint8_t x, uint64_t i) {
     assert(i < 8);
@@ -224,7 +249,7 @@ constexpr uint8_t LT_SEL[256 * 8] = {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7};
 
 // From sdsl-lite (https://github.com/simongog/sdsl-lite)
-constexpr uint64_t select(uint64_t x, uint64_t i) {
+constexpr uint64_t select_broadword(uint64_t x, uint64_t i) {
     assert(i != 0);
 #ifdef __SSE4_2__
     uint64_t s = x;
@@ -271,6 +296,50 @@ constexpr uint64_t select(uint64_t x, uint64_t i) {
 #endif
 }
 
+#ifdef POPLAR_CPU_DISPATCH
+__attribute__((target("bmi,bmi2"))) inline uint64_t select_bmi2(uint64_t x, uint64_t i) {
+    return _tzcnt_u64(_pdep_u64(1ULL << (i - 1), x));
+}
+#endif
+
+// Gets the position of the i-th 1 (i > 0) in x.
+inline uint64_t select(uint64_t x, uint64_t i) {
+    assert(i != 0);
+#if defined(__BMI2__)
+    return static_cast<uint64_t>(__builtin_ctzll(_pdep_u64(1ULL << (i - 1), x)));
+#elif defined(POPLAR_CPU_DISPATCH)
+    return get_cpu_features().bmi2 ? select_bmi2(x, i) : select_broadword(x, i);
+#else
+    return select_broadword(x, i);
+#endif
+}
+
+#ifdef POPLAR_CPU_DISPATCH
+__attribute__((target("popcnt,avx512f,avx512vpopcntdq"))) inline void popcnt_words_avx512(const uint64_t* words,
+                                                                                         uint64_t n, uint64_t* counts) {
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_si512(counts + i, _mm512_popcnt_epi64(_mm512_loadu_si512(words + i)));
+    }
+    for (; i < n; ++i) {
+        counts[i] = static_cast<uint64_t>(__builtin_popcountll(words[i]));
+    }
+}
+#endif
+
+// Writes the popcount of each of the n words to counts.
+inline void popcnt_words(const uint64_t* words, uint64_t n, uint64_t* counts) {
+#ifdef POPLAR_CPU_DISPATCH
+    if (get_cpu_features().avx512_vpopcntdq) {
+        popcnt_words_avx512(words, n, counts);
+        return;
+    }
+#endif
+    for (uint64_t i = 0; i < n; ++i) {
+        counts[i] = popcnt(words[i]);
+    }
+}
+
 #ifndef __SSE4_2__
 constexpr uint32_t MSB_TABLE[256] = {
     0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5,
@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "bit_tools.hpp"
+#include "exception.hpp"
 
 namespace poplar {
 
@@ -42,6 +43,9 @@ class bit_vector {
     void reserve(uint64_t capa) {
         chunks_.reserve(bit_tools::words_for(capa));
     }
+    void shrink_to_fit() {
+        chunks_.shrink_to_fit();
+    }
 
     ~bit_vector() = default;
 
@@ -102,6 +106,31 @@ class bit_vector {
     uint64_t size() const {
         return size_;
     }
+    uint64_t alloc_bytes() const {
+        return chunks_.capacity() * sizeof(uint64_t);
+    }
+
+    // Raw 64-bit words, where the i-th bit is stored in the (i % 64)-th bit of the (i / 64)-th word.
+    const uint64_t* data() const {
+        return chunks_.data();
+    }
+    uint64_t num_words() const {
+        return chunks_.size();
+    }
+
+    void save(std::ostream& os) const {
+        save_pod(os, size_);
+        save_vec(os, chunks_);
+    }
+    // The size must agree with the words read, which are not more than the stream has.
+    void load(std::istream& is) {
+        load_pod(is, size_);
+        load_vec(is, chunks_);
+        if (!is or chunks_.size() != size_ / 64 + (size_ % 64 != 0)) {
+            *this = bit_vector{};
+            POPLAR_THROW("Failed to read the bit vector.");
+        }
+    }
 
     bit_vector(const bit_vector&) = delete;
     bit_vector& operator=(const bit_vector&) = delete;
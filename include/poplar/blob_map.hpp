@@ -0,0 +1,191 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_BLOB_MAP_HPP
+#define POPLAR_TRIE_BLOB_MAP_HPP
+
+#include <iostream>
+#include <limits>
+
+#include "exception.hpp"
+#include "vbyte.hpp"
+
+namespace poplar {
+
+// This class implements an updatable associative array whose keys are strings and values are byte strings of
+// variable lengths (blobs). The blobs are appended to a log as vbyte(length) followed by the bytes, and Map of
+// integer values keeps the offsets to the log plus one so that zero indicates no blob.
+// Overwritten blobs are left in the log as dead bytes, which are reclaimed by compact().
+template <typename Map>
+class blob_map {
+  public:
+    using this_type = blob_map<Map>;
+    using map_type = Map;
+    using offset_type = typename Map::value_type;
+
+    static_assert(std::is_integral_v<offset_type>);
+
+    // The log is compacted when the dead bytes are over half of it and at least min_compaction_bytes.
+    static constexpr uint64_t min_compaction_bytes = 1ULL << 12;
+
+  public:
+    // Generic constructor.
+    blob_map() = default;
+
+    // Class constructor. Initially allocates the hash table of length 2**capa_bits.
+    explicit blob_map(uint32_t capa_bits, uint64_t lambda = 32) : map_{capa_bits, lambda} {}
+
+    // Generic destructor.
+    ~blob_map() = default;
+
+    // Searches the given key and returns the blob if registered; otherwise returns the range whose begin is
+    // nullptr. The range is invalidated by update() and compact().
+    char_range find(const std::string& key) const {
+        return find(make_char_range(key));
+    }
+    char_range find(char_range key) const {
+        auto vptr = map_.find(key);
+        if (vptr == nullptr or *vptr == 0) {
+            return {};
+        }
+        return get_blob_(*vptr - 1);
+    }
+
+    // Inserts or overwrites the blob of the given key. The blob must not be a range given by find().
+    void update(const std::string& key, std::string_view blob) {
+        update(make_char_range(key), reinterpret_cast<const uint8_t*>(blob.data()), blob.size());
+    }
+    void update(char_range key, const uint8_t* blob, uint64_t length) {
+        auto vptr = map_.update(key);
+
+        if (*vptr != 0) {
+            const uint64_t offset = *vptr - 1;
+            uint64_t old_length = 0;
+            const uint64_t header_bytes = vbyte::decode(log_.data() + offset, old_length);
+
+            if (old_length == length) {
+                // Overwrites in place since the record size is not changed.
+                copy_bytes(log_.data() + offset + header_bytes, blob, length);
+                return;
+            }
+            dead_bytes_ += header_bytes + old_length;
+        }
+
+        *vptr = append_blob_(blob, length);
+
+        if (min_compaction_bytes <= dead_bytes_ and log_.size() < dead_bytes_ * 2) {
+            compact();
+        }
+    }
+
+    // Rewrites the log with only the live blobs.
+    void compact() {
+        std::vector<uint8_t> old_log;
+        std::swap(log_, old_log);
+        log_.reserve(old_log.size() - dead_bytes_);
+        dead_bytes_ = 0;
+
+        map_.enumerate([&](std::string_view, auto&& value) {
+            if (value != 0) {
+                const uint8_t* ptr = old_log.data() + (value - 1);
+                uint64_t length = 0;
+                ptr += vbyte::decode(ptr, length);
+                value = append_blob_(ptr, length);
+            }
+        });
+    }
+
+    // Calls fn(key, blob) for every registered key in no particular order, where key is given as
+    // std::string_view without the terminator.
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        map_.enumerate([&](std::string_view key, offset_type value) {
+            if (value != 0) {
+                fn(key, get_blob_(value - 1));
+            }
+        });
+    }
+
+    // Gets the number of registered keys.
+    uint64_t size() const {
+        return map_.size();
+    }
+    // Gets the bytes of the log including the dead bytes.
+    uint64_t log_bytes() const {
+        return log_.size();
+    }
+    // Gets the bytes of the overwritten blobs in the log.
+    uint64_t dead_bytes() const {
+        return dead_bytes_;
+    }
+    uint64_t alloc_bytes() const {
+        return map_.alloc_bytes() + log_.capacity();
+    }
+
+    const map_type& get_map() const {
+        return map_;
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "blob_map");
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "log_bytes", log_bytes());
+        show_stat(os, indent, "dead_bytes", dead_bytes());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+        show_member(os, indent, "map_");
+        map_.show_stats(os, n + 1);
+    }
+
+    blob_map(const blob_map&) = delete;
+    blob_map& operator=(const blob_map&) = delete;
+
+    blob_map(blob_map&&) noexcept = default;
+    blob_map& operator=(blob_map&&) noexcept = default;
+
+  private:
+    map_type map_;
+    std::vector<uint8_t> log_;  // concatenation of vbyte(length) and the bytes of each blob
+    uint64_t dead_bytes_ = 0;
+
+    char_range get_blob_(uint64_t offset) const {
+        const uint8_t* ptr = log_.data() + offset;
+        uint64_t length = 0;
+        ptr += vbyte::decode(ptr, length);
+        return {ptr, ptr + length};
+    }
+
+    // Returns the offset plus one.
+    offset_type append_blob_(const uint8_t* blob, uint64_t length) {
+        const uint64_t offset = log_.size();
+        POPLAR_THROW_IF(std::numeric_limits<offset_type>::max() - 1 < offset, "The offset does not fit in the value.");
+
+        vbyte::append(log_, length);
+        log_.insert(log_.end(), blob, blob + length);
+        return static_cast<offset_type>(offset + 1);
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_BLOB_MAP_HPP
@@ -28,18 +28,24 @@
 #include <memory>
 #include <vector>
 
-#include "vbyte.hpp"
+#include "length_coders.hpp"
 
 namespace poplar {
 
-template <typename Value, uint64_t ChunkSize = 16>
+template <typename Value, uint64_t ChunkSize = 16, typename LengthCoder = vbyte_length_coder>
 class compact_bonsai_nlm {
   public:
-    using this_type = compact_bonsai_nlm<Value, ChunkSize>;
+    using this_type = compact_bonsai_nlm<Value, ChunkSize, LengthCoder>;
     using value_type = Value;
+    using value_pointer = value_type*;
+    using const_value_pointer = const value_type*;
     using chunk_type = typename chunk_type_traits<ChunkSize>::type;
+    using length_coder = LengthCoder;
 
     static constexpr auto trie_type_id = trie_type_ids::BONSAI_TRIE;
+    static constexpr bool stable_values = false;  // the values move with the labels
+    static constexpr uint64_t value_size = value_size_v<Value>;
+    static constexpr uint32_t key_bytes = 0;  // the keys are null-terminated
 
   public:
     compact_bonsai_nlm() = default;
@@ -54,21 +60,15 @@ class compact_bonsai_nlm {
         assert(ptrs_[chunk_id]);
         assert(bit_tools::get_bit(chunks_[chunk_id], pos_in_chunk));
 
-        const uint8_t* ptr = ptrs_[chunk_id].get();
-        const uint64_t offset = bit_tools::popcnt(chunks_[chunk_id], pos_in_chunk);
-
-        uint64_t alloc = 0;
-        for (uint64_t i = 0; i < offset; ++i) {
-            ptr += vbyte::decode(ptr, alloc);
-            ptr += alloc;
-        }
-        ptr += vbyte::decode(ptr, alloc);
+        const auto record = get_record_(chunk_id, pos_in_chunk);
+        const uint8_t* ptr = record.begin;
+        const uint64_t alloc = record.length();
 
         if (key.empty()) {
             return {reinterpret_cast<const value_type*>(ptr), 0};
         }
 
-        uint64_t length = alloc - sizeof(value_type);
+        uint64_t length = alloc - value_size;
         for (uint64_t i = 0; i < length; ++i) {
             if (key[i] != ptr[i]) {
                 return {nullptr, i};
@@ -83,11 +83,16 @@ class compact_bonsai_nlm {
         return {reinterpret_cast<const value_type*>(ptr + length), length + 1};
     };
 
-    value_type* insert(uint64_t pos, const char_range& key) {
+    // Gets the label at pos without the terminator.
+    char_range get_label(uint64_t pos) const {
         auto [chunk_id, pos_in_chunk] = decompose_value<ChunkSize>(pos);
+        auto record = get_record_(chunk_id, pos_in_chunk);
+        assert(value_size <= record.length());
+        return {record.begin, record.end - value_size};
+    }
 
-        assert(!bit_tools::get_bit(chunks_[chunk_id], pos_in_chunk));
-        bit_tools::set_bit(chunks_[chunk_id], pos_in_chunk);
+    value_type* insert(uint64_t pos, const char_range& key) {
+        auto [chunk_id, pos_in_chunk] = decompose_value<ChunkSize>(pos);
 
         ++size_;
 
@@ -96,91 +101,87 @@ class compact_bonsai_nlm {
         sum_length_ += key.length();
 #endif
 
-        if (!ptrs_[chunk_id]) {
-            // First association in the group
-            uint64_t length = key.empty() ? 0 : key.length() - 1;
-            uint64_t new_alloc = vbyte::size(length + sizeof(value_type)) + length + sizeof(value_type);
-            label_bytes_ += new_alloc;
-
-            ptrs_[chunk_id] = std::make_unique<uint8_t[]>(new_alloc);
-            uint8_t* ptr = ptrs_[chunk_id].get();
+        const uint64_t length = key.empty() ? 0 : key.length() - 1;
+        uint8_t* ptr = insert_record_(chunk_id, pos_in_chunk, length + value_size);
+        copy_bytes(ptr, key.begin, length);
 
-            ptr += vbyte::encode(ptr, length + sizeof(value_type));
-            copy_bytes(ptr, key.begin, length);
-
-            auto ret_ptr = reinterpret_cast<value_type*>(ptr + length);
+        auto ret_ptr = reinterpret_cast<value_type*>(ptr + length);
+        if constexpr (value_size != 0) {
             *ret_ptr = static_cast<value_type>(0);
-
-            return ret_ptr;
         }
 
-        // Second and subsequent association in the group
-        auto fr_alloc = get_allocs_(chunk_id, pos_in_chunk);
-
-        const uint64_t len = key.empty() ? 0 : key.length() - 1;
-        const uint64_t new_alloc = vbyte::size(len + sizeof(value_type)) + len + sizeof(value_type);
-        label_bytes_ += new_alloc;
-
-        auto new_unique = std::make_unique<uint8_t[]>(fr_alloc.first + new_alloc + fr_alloc.second);
-
-        // Get raw pointers
-        const uint8_t* orig_ptr = ptrs_[chunk_id].get();
-        uint8_t* new_ptr = new_unique.get();
+        return ret_ptr;
+    }
 
-        // Copy the front allocation
-        copy_bytes(new_ptr, orig_ptr, fr_alloc.first);
-        orig_ptr += fr_alloc.first;
-        new_ptr += fr_alloc.first;
+    template <typename T>
+    void expand(const T& pos_map) {
+        resize(pos_map, bit_tools::ceil_log2(ptrs_.size() * ChunkSize * 2));
+    }
 
-        // Set new allocation
-        new_ptr += vbyte::encode(new_ptr, len + sizeof(value_type));
-        copy_bytes(new_ptr, key.begin, len);
-        new_ptr += len;
-        *reinterpret_cast<value_type*>(new_ptr) = static_cast<value_type>(0);
+    // Moves the labels to the positions given by pos_map in a table of 2**capa_bits slots.
+    // The chunks are moved one by one, and each is decoded once and released as soon as its records are moved,
+    // so the labels are not held twice. The peak of the extra space over alloc_bytes() before the resize is
+    // reported by resize_extra_bytes().
+    template <typename T>
+    void resize(const T& pos_map, uint32_t capa_bits) {
+        assert(pos_map.size() == ptrs_.size() * ChunkSize);
 
-        // Copy the back allocation
-        copy_bytes(new_ptr + sizeof(value_type), orig_ptr, fr_alloc.second);
+        this_type new_ls(capa_bits);
 
-        // Overwrite
-        ptrs_[chunk_id] = std::move(new_unique);
+        const uint64_t old_bytes = alloc_bytes();
+        uint64_t rest_bytes = old_bytes;  // of this store during the resize
+        uint64_t peak_bytes = old_bytes;
+        char_range records[ChunkSize];
 
-        return reinterpret_cast<value_type*>(new_ptr);
-    }
+        for (uint64_t chunk_id = 0; chunk_id < ptrs_.size(); ++chunk_id) {
+            const uint64_t num = bit_tools::popcnt(chunks_[chunk_id]);
+            if (num == 0) {
+                continue;
+            }
+            LengthCoder::decode(ptrs_[chunk_id].get(), num, records);
 
-    template <typename T>
-    void expand(const T& pos_map) {
-        this_type new_ls(bit_tools::ceil_log2(ptrs_.size() * ChunkSize * 2));
-
-        for (uint64_t pos = 0; pos < pos_map.size(); ++pos) {
-            auto [chunk_id, pos_in_chunk] = decompose_value<ChunkSize>(pos);
-            uint64_t new_pos = pos_map[pos];
-            if (new_pos != UINT64_MAX) {
-                auto orig_slice = get_slice_(chunk_id, pos_in_chunk);
-                if (!orig_slice.empty()) {
+            for (uint64_t pos_in_chunk = 0, i = 0; i < num; ++pos_in_chunk) {
+                if (!bit_tools::get_bit(chunks_[chunk_id], pos_in_chunk)) {
+                    continue;
+                }
+                const char_range record = records[i++];
+                const uint64_t new_pos = pos_map[chunk_id * ChunkSize + pos_in_chunk];
+                if (new_pos != UINT64_MAX) {
                     auto [new_chunk_id, new_pos_in_chunk] = decompose_value<ChunkSize>(new_pos);
-                    new_ls.set_slice_(new_chunk_id, new_pos_in_chunk, orig_slice);
+                    copy_bytes(new_ls.insert_record_(new_chunk_id, new_pos_in_chunk, record.length()), record.begin,
+                               record.length());
                 }
             }
-            if (pos_in_chunk == ChunkSize - 1) {
-                ptrs_[chunk_id].reset();
-            }
+
+            peak_bytes = std::max(peak_bytes, rest_bytes + new_ls.alloc_bytes());
+            rest_bytes -= static_cast<uint64_t>(records[num - 1].end - ptrs_[chunk_id].get());
+            ptrs_[chunk_id].reset();
         }
 
         new_ls.size_ = size_;
+        new_ls.resize_extra_bytes_ = peak_bytes - old_bytes;
 #ifdef POPLAR_EXTRA_STATS
         new_ls.max_length_ = max_length_;
         new_ls.sum_length_ = sum_length_;
 #endif
-        new_ls.label_bytes_ = label_bytes_;
         *this = std::move(new_ls);
     }
 
+    void shrink_to_fit() {
+        ptrs_.shrink_to_fit();
+        chunks_.shrink_to_fit();
+    }
+
     uint64_t size() const {
         return size_;
     }
     uint64_t num_ptrs() const {
         return ptrs_.size();
     }
+    // Gets the peak of the extra bytes during the last resize, excluding the slack of the allocator.
+    uint64_t resize_extra_bytes() const {
+        return resize_extra_bytes_;
+    }
     uint64_t alloc_bytes() const {
         uint64_t bytes = 0;
         bytes += ptrs_.capacity() * sizeof(std::unique_ptr<uint8_t[]>);
@@ -189,17 +190,30 @@ class compact_bonsai_nlm {
         return bytes;
     }
 
+    // Estimates alloc_bytes() after storing num_labels labels of label_bytes bytes in total,
+    // excluding the terminators.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint64_t num_labels, uint64_t label_bytes) {
+        uint64_t num_chunks = (1ULL << capa_bits) / ChunkSize;
+        uint64_t bytes = 0;
+        bytes += num_chunks * sizeof(std::unique_ptr<uint8_t[]>);
+        bytes += num_chunks * sizeof(chunk_type);
+        bytes += LengthCoder::estimate_size(num_labels, label_bytes + num_labels * value_size, ChunkSize);
+        return bytes;
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "compact_bonsai_nlm");
         show_stat(os, indent, "size", size());
         show_stat(os, indent, "num_ptrs", num_ptrs());
         show_stat(os, indent, "alloc_bytes", alloc_bytes());
+        show_stat(os, indent, "resize_extra_bytes", resize_extra_bytes_);
 #ifdef POPLAR_EXTRA_STATS
         show_stat(os, indent, "max_length", max_length_);
         show_stat(os, indent, "ave_length", double(sum_length_) / size());
 #endif
         show_stat(os, indent, "chunk_size", ChunkSize);
+        show_stat(os, indent, "length_coder", LengthCoder::name);
     }
 
     compact_bonsai_nlm(const compact_bonsai_nlm&) = delete;
@@ -213,91 +227,35 @@ class compact_bonsai_nlm {
     std::vector<chunk_type> chunks_;
     uint64_t size_ = 0;
     uint64_t label_bytes_ = 0;
+    uint64_t resize_extra_bytes_ = 0;
 
 #ifdef POPLAR_EXTRA_STATS
     uint64_t max_length_ = 0;
     uint64_t sum_length_ = 0;
 #endif
 
-    std::pair<uint64_t, uint64_t> get_allocs_(uint64_t chunk_id, uint64_t pos_in_chunk) {
+    // Gets the record of the label and value at the position, which must be associated.
+    char_range get_record_(uint64_t chunk_id, uint64_t pos_in_chunk) const {
         assert(bit_tools::get_bit(chunks_[chunk_id], pos_in_chunk));
+        assert(ptrs_[chunk_id]);
 
-        const uint8_t* ptr = ptrs_[chunk_id].get();
-        assert(ptr != nullptr);
-
-        // -1 means the difference of the above bit_tools::set_bit
-        const uint64_t num = bit_tools::popcnt(chunks_[chunk_id]) - 1;
-        const uint64_t offset = bit_tools::popcnt(chunks_[chunk_id], pos_in_chunk);
-
-        uint64_t front_alloc = 0, back_alloc = 0;
-
-        for (uint64_t i = 0; i < num; ++i) {
-            uint64_t len = 0;
-            len += vbyte::decode(ptr, len);
-            if (i < offset) {
-                front_alloc += len;
-            } else {
-                back_alloc += len;
-            }
-            ptr += len;
-        }
-
-        return {front_alloc, back_alloc};
-    }
-
-    char_range get_slice_(uint64_t chunk_id, uint64_t pos_in_chunk) const {
-        if (!bit_tools::get_bit(chunks_[chunk_id], pos_in_chunk)) {
-            // pos indicates a step node
-            return {nullptr, nullptr};
-        }
-
-        const uint8_t* ptr = ptrs_[chunk_id].get();
-        assert(ptr != nullptr);
-
+        const uint64_t num = bit_tools::popcnt(chunks_[chunk_id]);
         const uint64_t offset = bit_tools::popcnt(chunks_[chunk_id], pos_in_chunk);
-
-        // Proceeds the target position
-        uint64_t len = 0;
-        for (uint64_t i = 0; i < offset; ++i) {
-            ptr += vbyte::decode(ptr, len);
-            ptr += len;
-        }
-
-        uint64_t vsize = vbyte::decode(ptr, len);
-        return {ptr, ptr + (vsize + len)};
+        return LengthCoder::get(ptrs_[chunk_id].get(), num, offset);
     }
 
-    void set_slice_(uint64_t chunk_id, uint64_t pos_in_chunk, char_range new_slice) {
+    // Inserts a new record of the given length at the position, and returns the pointer to the record to
+    // be written.
+    uint8_t* insert_record_(uint64_t chunk_id, uint64_t pos_in_chunk, uint64_t length) {
         assert(!bit_tools::get_bit(chunks_[chunk_id], pos_in_chunk));
 
+        const uint64_t num = bit_tools::popcnt(chunks_[chunk_id]);
+        const uint64_t offset = bit_tools::popcnt(chunks_[chunk_id], pos_in_chunk);
         bit_tools::set_bit(chunks_[chunk_id], pos_in_chunk);
-        const uint8_t* ptr = ptrs_[chunk_id].get();
-
-        if (ptr == nullptr) {
-            // First association in the group
-            ptrs_[chunk_id] = std::make_unique<uint8_t[]>(new_slice.length());
-            copy_bytes(ptrs_[chunk_id].get(), new_slice.begin, new_slice.length());
-            return;
-        }
-
-        // Second and subsequent association in the group
-        auto fr_alloc = get_allocs_(chunk_id, pos_in_chunk);
-        auto new_unique = std::make_unique<uint8_t[]>(fr_alloc.first + new_slice.length() + fr_alloc.second);
-
-        uint8_t* new_ptr = new_unique.get();
-
-        // Copy the front allocation
-        copy_bytes(new_ptr, ptr, fr_alloc.first);
-        ptr += fr_alloc.first;
-        new_ptr += fr_alloc.first;
-
-        // Set new label
-        copy_bytes(new_ptr, new_slice.begin, new_slice.length());
-        new_ptr += new_slice.length();
 
-        // Copy back
-        copy_bytes(new_ptr, ptr, fr_alloc.second);
-        ptrs_[chunk_id] = std::move(new_unique);
+        uint8_t* record = nullptr;
+        label_bytes_ += LengthCoder::insert(ptrs_[chunk_id], num, offset, length, record);
+        return record;
     }
 };
 
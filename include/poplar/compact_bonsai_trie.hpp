@@ -28,6 +28,7 @@
 #include "bit_vector.hpp"
 #include "compact_hash_table.hpp"
 #include "compact_vector.hpp"
+#include "exception.hpp"
 #include "standard_hash_table.hpp"
 
 namespace poplar {
@@ -45,6 +46,7 @@ class compact_bonsai_trie {
 
     static constexpr uint64_t nil_id = UINT64_MAX;
     static constexpr uint32_t min_capa_bits = 16;
+    static constexpr uint32_t max_factor = MaxFactor;
 
     static constexpr uint32_t dsp1_bits = Dsp1Bits;
     static constexpr uint64_t dsp1_mask = (1ULL << dsp1_bits) - 1;
@@ -155,6 +157,17 @@ class compact_bonsai_trie {
         return std::make_pair(key >> symb_size_.bits(), key & symb_size_.mask());
     }
 
+    // Calls fn(parent, symb, child) for every edge in the slot order.
+    template <typename Fn>
+    void for_each_edge(Fn fn) const {
+        for (uint64_t i = 0; i < capa_size_.size(); ++i) {
+            auto [parent, symb] = get_parent_and_symb(i);
+            if (parent != nil_id) {
+                fn(parent, symb, i);
+            }
+        }
+    }
+
     class node_map {
       public:
         node_map() = default;
@@ -196,8 +209,14 @@ class compact_bonsai_trie {
     }
 
     node_map expand() {
-        // this_type new_ht{capa_bits() + 1, symb_size_.bits(), aux_cht_.capa_bits()};
-        this_type new_ht{capa_bits() + 1, symb_size_.bits()};
+        return resize(capa_bits() + 1);
+    }
+
+    // Rebuilds the trie with 2**capa_bits slots and returns the mapping from old to new node IDs.
+    node_map resize(uint32_t capa_bits) {
+        // this_type new_ht{capa_bits, symb_size_.bits(), aux_cht_.capa_bits()};
+        this_type new_ht{capa_bits, symb_size_.bits()};
+        POPLAR_THROW_IF(new_ht.max_size() <= size(), "capa_bits is too small to store the nodes.");
         new_ht.add_root();
 
 #ifdef POPLAR_EXTRA_STATS
@@ -297,6 +316,15 @@ class compact_bonsai_trie {
         return bytes;
     }
 
+    // Estimates alloc_bytes() just after construction with the given parameters.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint32_t symb_bits) {
+        capa_bits = std::max(min_capa_bits, capa_bits);
+        uint64_t bytes = 0;
+        bytes += bit_tools::words_for((1ULL << capa_bits) * (symb_bits + dsp1_bits)) * sizeof(uint64_t);
+        bytes += aux_cht_type::estimate_alloc_bytes(capa_bits);
+        return bytes;
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "compact_hash_trie");
@@ -28,18 +28,24 @@
 #include <memory>
 #include <vector>
 
-#include "vbyte.hpp"
+#include "length_coders.hpp"
 
 namespace poplar {
 
-template <typename Value, uint64_t ChunkSize = 16>
+template <typename Value, uint64_t ChunkSize = 16, typename LengthCoder = vbyte_length_coder>
 class compact_fkhash_nlm {
   public:
-    using this_type = compact_fkhash_nlm<Value, ChunkSize>;
+    using this_type = compact_fkhash_nlm<Value, ChunkSize, LengthCoder>;
     using value_type = Value;
+    using value_pointer = value_type*;
+    using const_value_pointer = const value_type*;
     using chunk_type = typename chunk_type_traits<ChunkSize>::type;
+    using length_coder = LengthCoder;
 
     static constexpr auto trie_type_id = trie_type_ids::FKHASH_TRIE;
+    static constexpr bool stable_values = false;  // the values move with the labels
+    static constexpr uint64_t value_size = value_size_v<Value>;
+    static constexpr uint32_t key_bytes = 0;  // the keys are null-terminated
 
   public:
     compact_fkhash_nlm() = default;
@@ -47,37 +53,21 @@ class compact_fkhash_nlm {
     explicit compact_fkhash_nlm(uint32_t capa_bits) {
         chunk_ptrs_.reserve((1ULL << capa_bits) / ChunkSize);
         chunk_buf_.reserve(1ULL << 10);
+        buf_ends_.reserve(ChunkSize);
     }
 
     ~compact_fkhash_nlm() = default;
 
     std::pair<const value_type*, uint64_t> compare(uint64_t pos, const char_range& key) const {
-        assert(pos < size_);
-
-        const uint8_t* char_ptr = nullptr;
-        auto [chunk_id, pos_in_chunk] = decompose_value<ChunkSize>(pos);
-
-        if (chunk_id < chunk_ptrs_.size()) {
-            char_ptr = chunk_ptrs_[chunk_id].get();
-        } else {
-            assert(chunk_id == chunk_ptrs_.size());
-            char_ptr = chunk_buf_.data();
-        }
-
-        uint64_t alloc = 0;
-        for (uint64_t i = 0; i < pos_in_chunk; ++i) {
-            char_ptr += vbyte::decode(char_ptr, alloc);
-            char_ptr += alloc;
-        }
-        char_ptr += vbyte::decode(char_ptr, alloc);
+        auto [char_ptr, alloc] = get_alloc_(pos);
 
         if (key.empty()) {
             return {reinterpret_cast<const value_type*>(char_ptr), 0};
         }
 
-        assert(sizeof(value_type) <= alloc);
+        assert(value_size <= alloc);
 
-        uint64_t length = alloc - sizeof(value_type);
+        uint64_t length = alloc - value_size;
         for (uint64_t i = 0; i < length; ++i) {
             if (key[i] != char_ptr[i]) {
                 return {nullptr, i};
@@ -92,6 +82,13 @@ class compact_fkhash_nlm {
         return {reinterpret_cast<const value_type*>(char_ptr + length), length + 1};
     };
 
+    // Gets the label at pos without the terminator.
+    char_range get_label(uint64_t pos) const {
+        auto [char_ptr, alloc] = get_alloc_(pos);
+        assert(value_size <= alloc);
+        return {char_ptr, char_ptr + (alloc - value_size)};
+    }
+
     value_type* append(const char_range& key) {
         auto [chunk_id, pos_in_chunk] = decompose_value<ChunkSize>(size_++);
         if (chunk_id != 0 && pos_in_chunk == 0) {
@@ -104,13 +101,13 @@ class compact_fkhash_nlm {
 #endif
 
         uint64_t length = key.empty() ? 0 : key.length() - 1;
-        vbyte::append(chunk_buf_, length + sizeof(value_type));
         std::copy(key.begin, key.begin + length, std::back_inserter(chunk_buf_));
-        for (size_t i = 0; i < sizeof(value_type); ++i) {
+        for (size_t i = 0; i < value_size; ++i) {
             chunk_buf_.emplace_back('\0');
         }
+        buf_ends_.push_back(chunk_buf_.size());
 
-        return reinterpret_cast<value_type*>(chunk_buf_.data() + chunk_buf_.size() - sizeof(value_type));
+        return reinterpret_cast<value_type*>(chunk_buf_.data() + chunk_buf_.size() - value_size);
     }
 
     // Associate a dummy label
@@ -120,7 +117,18 @@ class compact_fkhash_nlm {
             release_buf_();
         }
 
-        vbyte::append(chunk_buf_, 0);
+        buf_ends_.push_back(chunk_buf_.size());
+    }
+
+    // Reserves the space for num_nodes nodes.
+    void reserve(uint64_t num_nodes) {
+        chunk_ptrs_.reserve(num_nodes / ChunkSize);
+    }
+
+    void shrink_to_fit() {
+        chunk_ptrs_.shrink_to_fit();
+        chunk_buf_.shrink_to_fit();
+        buf_ends_.shrink_to_fit();
     }
 
     uint64_t size() const {
@@ -133,10 +141,20 @@ class compact_fkhash_nlm {
         uint64_t bytes = 0;
         bytes += chunk_ptrs_.capacity() * sizeof(std::unique_ptr<uint8_t[]>);
         bytes += chunk_buf_.capacity();
+        bytes += buf_ends_.capacity() * sizeof(uint64_t);
         bytes += label_bytes_;
         return bytes;
     }
 
+    // Estimates alloc_bytes() after storing num_labels labels of label_bytes bytes in total,
+    // excluding the terminators.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint64_t num_labels, uint64_t label_bytes) {
+        uint64_t bytes = 0;
+        bytes += (1ULL << capa_bits) / ChunkSize * sizeof(std::unique_ptr<uint8_t[]>);
+        bytes += LengthCoder::estimate_size(num_labels, label_bytes + num_labels * value_size, ChunkSize);
+        return bytes;
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "compact_fkhash_nlm");
@@ -148,6 +166,7 @@ class compact_fkhash_nlm {
         show_stat(os, indent, "ave_length", double(sum_length_) / size());
 #endif
         show_stat(os, indent, "chunk_size", ChunkSize);
+        show_stat(os, indent, "length_coder", LengthCoder::name);
     }
 
     compact_fkhash_nlm(const compact_fkhash_nlm&) = delete;
@@ -158,7 +177,8 @@ class compact_fkhash_nlm {
 
   private:
     std::vector<std::unique_ptr<uint8_t[]>> chunk_ptrs_;
-    std::vector<uint8_t> chunk_buf_;  // for the last chunk
+    std::vector<uint8_t> chunk_buf_;  // records of the last chunk
+    std::vector<uint64_t> buf_ends_;  // end offsets of the records in chunk_buf_
     uint64_t size_ = 0;
     uint64_t label_bytes_ = 0;
 
@@ -167,12 +187,44 @@ class compact_fkhash_nlm {
     uint64_t sum_length_ = 0;
 #endif
 
+    // Returns the pointer to the allocation at pos and its length.
+    std::pair<const uint8_t*, uint64_t> get_alloc_(uint64_t pos) const {
+        assert(pos < size_);
+
+        auto [chunk_id, pos_in_chunk] = decompose_value<ChunkSize>(pos);
+
+        if (chunk_id < chunk_ptrs_.size()) {
+            auto record = LengthCoder::get(chunk_ptrs_[chunk_id].get(), ChunkSize, pos_in_chunk);
+            return {record.begin, record.length()};
+        }
+
+        assert(chunk_id == chunk_ptrs_.size());
+        const uint64_t begin = pos_in_chunk == 0 ? 0 : buf_ends_[pos_in_chunk - 1];
+        return {chunk_buf_.data() + begin, buf_ends_[pos_in_chunk] - begin};
+    }
+
+    // Encodes the full last chunk with LengthCoder.
     void release_buf_() {
-        label_bytes_ += chunk_buf_.size();
-        auto new_uptr = std::make_unique<uint8_t[]>(chunk_buf_.size());
-        std::copy(chunk_buf_.begin(), chunk_buf_.end(), new_uptr.get());
+        assert(buf_ends_.size() == ChunkSize);
+
+        uint64_t lengths[ChunkSize];
+        uint8_t* payloads[ChunkSize];
+        for (uint64_t i = 0; i < ChunkSize; ++i) {
+            lengths[i] = buf_ends_[i] - (i == 0 ? 0 : buf_ends_[i - 1]);
+        }
+
+        const uint64_t new_size = LengthCoder::size(lengths, ChunkSize);
+        label_bytes_ += new_size;
+
+        auto new_uptr = std::make_unique<uint8_t[]>(new_size);
+        LengthCoder::encode(new_uptr.get(), lengths, ChunkSize, payloads);
+        for (uint64_t i = 0; i < ChunkSize; ++i) {
+            copy_bytes(payloads[i], chunk_buf_.data() + (buf_ends_[i] - lengths[i]), lengths[i]);
+        }
+
         chunk_ptrs_.emplace_back(std::move(new_uptr));
         chunk_buf_.clear();
+        buf_ends_.clear();
     }
 };
 
@@ -28,6 +28,7 @@
 #include "bit_vector.hpp"
 #include "compact_hash_table.hpp"
 #include "compact_vector.hpp"
+#include "exception.hpp"
 #include "standard_hash_table.hpp"
 
 namespace poplar {
@@ -45,6 +46,7 @@ class compact_fkhash_trie {
 
     static constexpr uint64_t nil_id = UINT64_MAX;
     static constexpr uint32_t min_capa_bits = 16;
+    static constexpr uint32_t max_factor = MaxFactor;
 
     static constexpr uint32_t dsp1_bits = Dsp1Bits;
     static constexpr uint64_t dsp1_mask = (1ULL << dsp1_bits) - 1;
@@ -131,6 +133,84 @@ class compact_fkhash_trie {
         return max_size() <= size();
     }
 
+    // Calls fn(parent, symb, child) for every edge in the slot order.
+    template <typename Fn>
+    void for_each_edge(Fn fn) const {
+        for (uint64_t i = 0; i < capa_size_.size(); ++i) {
+            uint64_t child_id = ids_[i];
+            if (child_id == capa_size_.mask()) {
+                // encounter an empty slot
+                continue;
+            }
+
+            uint64_t dist = get_dsp_(i);
+            uint64_t init_id = dist <= i ? i - dist : table_.size() - (dist - i);
+            uint64_t key = hasher_.hash_inv(get_quo_(i) << capa_size_.bits() | init_id);
+            fn(key >> symb_size_.bits(), key & symb_size_.mask(), child_id);
+        }
+    }
+
+    // Rebuilds the trie with 2**capa_bits slots. The node IDs are kept.
+    void resize(uint32_t capa_bits) {
+        this_type new_ht{capa_bits, symb_size_.bits()};
+        POPLAR_THROW_IF(new_ht.max_size() <= size(), "capa_bits is too small to store the nodes.");
+#ifdef POPLAR_EXTRA_STATS
+        new_ht.num_resize_ = num_resize_ + 1;
+#endif
+
+        // The original keys are restored and rehashed in batches to amortize the hashing cost.
+        // The home slots of a batch are prefetched before the insertions because they are scattered.
+        constexpr uint64_t batch_size = 64;
+        uint64_t keys[batch_size];
+        uint64_t node_ids[batch_size];
+        uint64_t num_keys = 0;
+
+        auto flush = [&]() {
+            hasher_.hash_inv_n(keys, keys, num_keys);
+            new_ht.hasher_.hash_n(keys, keys, num_keys);
+
+            for (uint64_t j = 0; j < num_keys; ++j) {
+                uint64_t mod = new_ht.decompose_(keys[j]).second;
+                new_ht.table_.prefetch(mod);
+                new_ht.ids_.prefetch(mod);
+            }
+
+            for (uint64_t j = 0; j < num_keys; ++j) {
+                auto [quo, mod] = new_ht.decompose_(keys[j]);
+                for (uint64_t new_i = mod, cnt = 0;; new_i = new_ht.right_(new_i), ++cnt) {
+                    if (new_ht.ids_[new_i] == new_ht.capa_size_.mask()) {
+                        // encounter an empty slot
+                        new_ht.update_slot_(new_i, quo, cnt, node_ids[j]);
+                        break;
+                    }
+                }
+            }
+            num_keys = 0;
+        };
+
+        for (uint64_t i = 0; i < capa_size_.size(); ++i) {
+            uint64_t node_id = ids_[i];
+
+            if (node_id == capa_size_.mask()) {
+                // encounter an empty slot
+                continue;
+            }
+
+            uint64_t dist = get_dsp_(i);
+            uint64_t init_id = dist <= i ? i - dist : table_.size() - (dist - i);
+
+            keys[num_keys] = get_quo_(i) << capa_size_.bits() | init_id;
+            node_ids[num_keys] = node_id;
+            if (++num_keys == batch_size) {
+                flush();
+            }
+        }
+        flush();
+
+        new_ht.size_ = size_;
+        std::swap(*this, new_ht);
+    }
+
     uint64_t size() const {
         return size_;
     }
@@ -163,6 +243,16 @@ class compact_fkhash_trie {
         return bytes;
     }
 
+    // Estimates alloc_bytes() just after construction with the given parameters.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint32_t symb_bits) {
+        capa_bits = std::max(min_capa_bits, capa_bits);
+        uint64_t bytes = 0;
+        bytes += bit_tools::words_for((1ULL << capa_bits) * (symb_bits + dsp1_bits)) * sizeof(uint64_t);
+        bytes += aux_cht_type::estimate_alloc_bytes(capa_bits);
+        bytes += bit_tools::words_for((1ULL << capa_bits) * capa_bits) * sizeof(uint64_t);
+        return bytes;
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "compact_fkhash_trie");
@@ -291,36 +381,7 @@ class compact_fkhash_trie {
     }
 
     void expand_() {
-        this_type new_ht{capa_bits() + 1, symb_size_.bits()};
-#ifdef POPLAR_EXTRA_STATS
-        new_ht.num_resize_ = num_resize_ + 1;
-#endif
-
-        for (uint64_t i = 0; i < capa_size_.size(); ++i) {
-            uint64_t node_id = ids_[i];
-
-            if (node_id == capa_size_.mask()) {
-                // encounter an empty slot
-                continue;
-            }
-
-            uint64_t dist = get_dsp_(i);
-            uint64_t init_id = dist <= i ? i - dist : table_.size() - (dist - i);
-            uint64_t key = hasher_.hash_inv(get_quo_(i) << capa_size_.bits() | init_id);
-
-            auto [quo, mod] = new_ht.decompose_(new_ht.hasher_.hash(key));
-
-            for (uint64_t new_i = mod, cnt = 0;; new_i = new_ht.right_(new_i), ++cnt) {
-                if (new_ht.ids_[new_i] == new_ht.capa_size_.mask()) {
-                    // encounter an empty slot
-                    new_ht.update_slot_(new_i, quo, cnt, node_id);
-                    break;
-                }
-            }
-        }
-
-        new_ht.size_ = size_;
-        std::swap(*this, new_ht);
+        resize(capa_bits() + 1);
     }
 };
 
@@ -169,6 +169,21 @@ class compact_hash_table {
         const uint64_t beg = i;
         i = right_(i);  // skip the vacant
 
+        // The original keys are restored in batches to amortize the hashing cost
+        constexpr uint64_t batch_size = 64;
+        uint64_t keys[batch_size];
+        uint64_t vals[batch_size];
+        uint64_t num_keys = 0;
+
+        auto flush = [&]() {
+            hasher_.hash_inv_n(keys, keys, num_keys);
+            for (uint64_t j = 0; j < num_keys; ++j) {
+                // new_cht.set(key, val);
+                mapper(new_cht, keys[j], vals[j]);
+            }
+            num_keys = 0;
+        };
+
         for (bool completed = false; !completed;) {
             // Find the leftmost of some collision groups
             while (is_vacant_(i)) {
@@ -190,10 +205,11 @@ class compact_hash_table {
                 do {
                     assert(!is_vacant_(i));
 
-                    uint64_t key = hasher_.hash_inv((get_quo_(i) << capa_size_.bits()) | init_id);
-                    uint64_t val = get_val_(i);
-                    // new_cht.set(key, val);
-                    mapper(new_cht, key, val);
+                    keys[num_keys] = (get_quo_(i) << capa_size_.bits()) | init_id;
+                    vals[num_keys] = get_val_(i);
+                    if (++num_keys == batch_size) {
+                        flush();
+                    }
 
                     i = right_(i);
                     if (i == beg) {
@@ -204,6 +220,7 @@ class compact_hash_table {
                 init_id = right_(init_id);
             } while (i != init_id);
         }
+        flush();
 
         assert(size() == new_cht.size());
     }
@@ -230,6 +247,13 @@ class compact_hash_table {
         return table_.alloc_bytes();
     }
 
+    // Estimates alloc_bytes() just after construction with the given parameters.
+    static uint64_t estimate_alloc_bytes(uint32_t univ_bits, uint32_t capa_bits = min_capa_bits) {
+        capa_bits = std::max(min_capa_bits, capa_bits);
+        uint64_t width = univ_bits - capa_bits + val_bits + 2;
+        return bit_tools::words_for((1ULL << capa_bits) * width) * sizeof(uint64_t);
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "compact_hash_table");
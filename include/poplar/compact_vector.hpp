@@ -56,6 +56,12 @@ class compact_vector {
         size_ = size;
         chunks_.resize(bit_tools::words_for(size_ * width_));
     }
+    void reserve(uint64_t size) {
+        chunks_.reserve(bit_tools::words_for(size * width_));
+    }
+    void shrink_to_fit() {
+        chunks_.shrink_to_fit();
+    }
 
     uint64_t operator[](uint64_t i) const {
         return get(i);
@@ -89,6 +95,12 @@ class compact_vector {
         }
     }
 
+    // Hints the processor to fetch the word including the i-th element.
+    void prefetch(uint64_t i) const {
+        assert(i < size_);
+        __builtin_prefetch(chunks_.data() + (i * width_) / 64);
+    }
+
     uint64_t size() const {
         return size_;
     }
@@ -99,6 +111,26 @@ class compact_vector {
         return chunks_.capacity() * sizeof(uint64_t);
     }
 
+    void save(std::ostream& os) const {
+        save_pod(os, size_);
+        save_pod(os, mask_);
+        save_pod(os, width_);
+        save_vec(os, chunks_);
+    }
+    // The size and the width must agree with the words read, which are not more than the stream has.
+    void load(std::istream& is) {
+        load_pod(is, size_);
+        load_pod(is, mask_);
+        load_pod(is, width_);
+        load_vec(is, chunks_);
+        if (!is or 64 <= width_ or mask_ != (1ULL << width_) - 1 or
+            (width_ != 0 and chunks_.size() * 64 / width_ < size_) or
+            chunks_.size() != bit_tools::words_for(size_ * width_)) {
+            *this = compact_vector{};
+            POPLAR_THROW("Failed to read the compact vector.");
+        }
+    }
+
     compact_vector(const compact_vector&) = delete;
     compact_vector& operator=(const compact_vector&) = delete;
 
@@ -0,0 +1,168 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_CONCURRENT_COUNTER_HPP
+#define POPLAR_TRIE_CONCURRENT_COUNTER_HPP
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+
+#include "map.hpp"
+#include "value_array_nlm.hpp"
+
+namespace poplar {
+
+// This class implements a map from strings to counters that can be incremented from many threads, e.g., for
+// n-gram counting. The counters are kept aligned in value_array_nlm so that they can be updated with atomic
+// instructions. Searches and increments of registered keys share the lock, and only insertions of new keys
+// take it exclusively.
+template <typename Trie, typename LabelNLM, typename Counter = uint64_t>
+class concurrent_counter {
+    static_assert(std::is_same_v<Counter, uint32_t> or std::is_same_v<Counter, uint64_t>);
+
+  public:
+    using this_type = concurrent_counter<Trie, LabelNLM, Counter>;
+    using map_type = map<Trie, value_array_nlm<LabelNLM, value_vector<Counter>>>;
+    using counter_type = Counter;
+
+  public:
+    // Generic constructor.
+    concurrent_counter() = default;
+
+    // Class constructor. Initially allocates the hash table of length 2**capa_bits.
+    explicit concurrent_counter(uint32_t capa_bits, uint64_t lambda = 32) : map_{capa_bits, lambda} {
+        capa_size_ = map_.capa_size();
+    }
+
+    // Generic destructor.
+    ~concurrent_counter() = default;
+
+    // Adds delta to the counter of the given key and returns the previous count.
+    counter_type add(const std::string& key, counter_type delta = 1) {
+        return add(make_char_range(key), delta);
+    }
+    counter_type add(char_range key, counter_type delta = 1) {
+        {
+            std::shared_lock lock{mutex_};
+            if (auto ptr = map_.find(key); ptr != nullptr) {
+                return fetch_add(const_cast<counter_type*>(ptr), delta);
+            }
+        }
+        std::unique_lock lock{mutex_};
+        return fetch_add(update_(key), delta);
+    }
+
+    // Gets the count of the given key, which is zero if not registered.
+    counter_type get(const std::string& key) const {
+        return get(make_char_range(key));
+    }
+    counter_type get(char_range key) const {
+        std::shared_lock lock{mutex_};
+        auto ptr = map_.find(key);
+        return ptr != nullptr ? __atomic_load_n(ptr, __ATOMIC_RELAXED) : 0;
+    }
+
+    // Inserts the given key and returns the pointer to its counter, which must be updated through fetch_add().
+    // The pointer is not guarded by the lock, so an insertion resizing the hash table frees the counter even
+    // while other threads use it, and comparing epoch() before the use cannot prevent it. Therefore, the pointers
+    // may be used only while no insertion can exceed the capacity prepared by reserve().
+    counter_type* update(const std::string& key) {
+        return update(make_char_range(key));
+    }
+    counter_type* update(char_range key) {
+        std::unique_lock lock{mutex_};
+        return update_(key);
+    }
+
+    static counter_type fetch_add(counter_type* ptr, counter_type delta) {
+        return __atomic_fetch_add(ptr, delta, __ATOMIC_RELAXED);
+    }
+
+    // Gets the number of times the counters have been relocated, e.g., to check afterwards that the capacity
+    // prepared by reserve() sufficed.
+    uint64_t epoch() const {
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    // Prepares the hash table as map::reserve().
+    void reserve(uint64_t num_keys, uint64_t avg_key_len) {
+        std::unique_lock lock{mutex_};
+        map_.reserve(num_keys, avg_key_len);
+        update_epoch_();
+    }
+
+    // Calls fn(key, count) for every registered key in no particular order.
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        std::shared_lock lock{mutex_};
+        map_.enumerate([&](std::string_view key, const counter_type& count) {  //
+            fn(key, __atomic_load_n(&count, __ATOMIC_RELAXED));
+        });
+    }
+
+    uint64_t size() const {
+        std::shared_lock lock{mutex_};
+        return map_.size();
+    }
+    uint64_t alloc_bytes() const {
+        std::shared_lock lock{mutex_};
+        return map_.alloc_bytes();
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        std::shared_lock lock{mutex_};
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "concurrent_counter");
+        show_stat(os, indent, "epoch", epoch());
+        show_member(os, indent, "map_");
+        map_.show_stats(os, n + 1);
+    }
+
+    concurrent_counter(const concurrent_counter&) = delete;
+    concurrent_counter& operator=(const concurrent_counter&) = delete;
+
+  private:
+    map_type map_;
+    mutable std::shared_mutex mutex_;
+    std::atomic<uint64_t> epoch_ = 0;
+    uint64_t capa_size_ = 0;  // of the last epoch
+
+    // Needs the exclusive lock.
+    counter_type* update_(char_range key) {
+        counter_type* ptr = map_.update(key);
+        update_epoch_();
+        return ptr;
+    }
+    void update_epoch_() {
+        if (capa_size_ != map_.capa_size()) {
+            capa_size_ = map_.capa_size();
+            epoch_.fetch_add(1, std::memory_order_release);
+        }
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_CONCURRENT_COUNTER_HPP
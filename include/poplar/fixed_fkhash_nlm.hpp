@@ -0,0 +1,194 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_FIXED_FKHASH_NLM_HPP
+#define POPLAR_TRIE_FIXED_FKHASH_NLM_HPP
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "basics.hpp"
+
+namespace poplar {
+
+// NLM for the keys of exactly KeyBytes bytes, which are stored without the terminator and may contain any byte.
+// The label of a node is the rest of the key after the node's depth, so its length is given by the caller: it is
+// the length of the key passed to compare(), and get_label() takes it. Each label is therefore stored without any
+// length in a record of KeyBytes - 1 bytes followed by the value, and the record of a node is found by its ID
+// without decoding. The labels shorter than KeyBytes - 1 leave the rest of the records unused, which costs about
+// the depth of the nodes in bytes. The root, whose label is the whole key, has its own record. The records are
+// allocated in blocks of 2**BlockBits, so they are never moved.
+template <typename Value, uint32_t KeyBytes, uint32_t BlockBits = 12>
+class fixed_fkhash_nlm {
+    static_assert(0 < KeyBytes);
+
+  public:
+    using this_type = fixed_fkhash_nlm<Value, KeyBytes, BlockBits>;
+    using value_type = Value;
+    using value_pointer = value_type*;
+    using const_value_pointer = const value_type*;
+
+    static constexpr auto trie_type_id = trie_type_ids::FKHASH_TRIE;
+    static constexpr bool stable_values = true;
+    static constexpr uint64_t value_size = value_size_v<Value>;
+    static constexpr uint32_t key_bytes = KeyBytes;
+    static constexpr uint64_t record_size = KeyBytes - 1 + value_size;
+    static constexpr uint64_t block_size = 1ULL << BlockBits;
+
+  public:
+    fixed_fkhash_nlm() = default;
+
+    explicit fixed_fkhash_nlm(uint32_t capa_bits) {
+        blocks_.reserve(((1ULL << capa_bits) >> BlockBits) + 1);
+    }
+
+    ~fixed_fkhash_nlm() = default;
+
+    std::pair<const value_type*, uint64_t> compare(uint64_t pos, const char_range& key) const {
+        const uint8_t* ptr = get_record_(pos);
+        assert(key.length() <= (pos == 0 ? KeyBytes : KeyBytes - 1));
+
+        for (uint64_t i = 0; i < key.length(); ++i) {
+            if (key[i] != ptr[i]) {
+                return {nullptr, i};
+            }
+        }
+        return {get_value_(pos, ptr), key.length()};
+    }
+
+    // Gets the label at pos, whose length is KeyBytes minus the depth of the node.
+    char_range get_label(uint64_t pos, uint64_t length) const {
+        const uint8_t* ptr = get_record_(pos);
+        return {ptr, ptr + length};
+    }
+
+    value_type* append(const char_range& key) {
+        assert(key.length() < (size_ == 0 ? KeyBytes + 1 : KeyBytes));
+
+        uint8_t* ptr = add_record_();
+        copy_bytes(ptr, key.begin, key.length());
+
+#ifdef POPLAR_EXTRA_STATS
+        max_length_ = std::max<uint64_t>(max_length_, key.length());
+        sum_length_ += key.length();
+#endif
+
+        auto ret = const_cast<value_type*>(get_value_(size_ - 1, ptr));
+        if constexpr (value_size != 0) {
+            *ret = static_cast<value_type>(0);
+        }
+        return ret;
+    }
+
+    // The step nodes take unused records, which never appear if lambda is not less than KeyBytes.
+    void append_dummy() {
+        assert(size_ != 0);
+        add_record_();
+    }
+
+    // Reserves the space for num_nodes nodes.
+    void reserve(uint64_t num_nodes) {
+        blocks_.reserve((num_nodes >> BlockBits) + 1);
+    }
+
+    void shrink_to_fit() {
+        blocks_.shrink_to_fit();
+    }
+
+    uint64_t size() const {
+        return size_;
+    }
+    uint64_t alloc_bytes() const {
+        uint64_t bytes = 0;
+        bytes += sizeof(root_);
+        bytes += blocks_.capacity() * sizeof(std::unique_ptr<uint8_t[]>);
+        bytes += blocks_.size() * block_size * record_size;
+        return bytes;
+    }
+
+    // Estimates alloc_bytes() after storing num_labels labels, whose bytes are not needed.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint64_t num_labels, uint64_t) {
+        const uint64_t num_blocks = (num_labels + block_size - 1) >> BlockBits;
+        uint64_t bytes = 0;
+        bytes += sizeof(root_);
+        bytes += (((1ULL << capa_bits) >> BlockBits) + 1) * sizeof(std::unique_ptr<uint8_t[]>);
+        bytes += num_blocks * block_size * record_size;
+        return bytes;
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "fixed_fkhash_nlm");
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "key_bytes", KeyBytes);
+        show_stat(os, indent, "num_blocks", blocks_.size());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+#ifdef POPLAR_EXTRA_STATS
+        show_stat(os, indent, "max_length", max_length_);
+        show_stat(os, indent, "ave_length", double(sum_length_) / size());
+#endif
+    }
+
+    fixed_fkhash_nlm(const fixed_fkhash_nlm&) = delete;
+    fixed_fkhash_nlm& operator=(const fixed_fkhash_nlm&) = delete;
+
+    fixed_fkhash_nlm(fixed_fkhash_nlm&&) noexcept = default;
+    fixed_fkhash_nlm& operator=(fixed_fkhash_nlm&&) noexcept = default;
+
+  private:
+    uint8_t root_[KeyBytes + value_size] = {};
+    std::vector<std::unique_ptr<uint8_t[]>> blocks_;  // records of the nodes except the root
+    uint64_t size_ = 0;
+#ifdef POPLAR_EXTRA_STATS
+    uint64_t max_length_ = 0;
+    uint64_t sum_length_ = 0;
+#endif
+
+    const uint8_t* get_record_(uint64_t pos) const {
+        assert(pos < size_);
+        if (pos == 0) {
+            return root_;
+        }
+        auto [block_id, pos_in_block] = decompose_value<block_size>(pos - 1);
+        return blocks_[block_id].get() + pos_in_block * record_size;
+    }
+    uint8_t* add_record_() {
+        if (size_++ == 0) {
+            return root_;
+        }
+        auto [block_id, pos_in_block] = decompose_value<block_size>(size_ - 2);
+        if (pos_in_block == 0) {
+            blocks_.emplace_back(std::make_unique<uint8_t[]>(block_size * record_size));
+        }
+        return blocks_[block_id].get() + pos_in_block * record_size;
+    }
+    const value_type* get_value_(uint64_t pos, const uint8_t* ptr) const {
+        return reinterpret_cast<const value_type*>(ptr + (pos == 0 ? KeyBytes : KeyBytes - 1));
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_FIXED_FKHASH_NLM_HPP
@@ -0,0 +1,157 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_FRONT_CACHE_HPP
+#define POPLAR_TRIE_FRONT_CACHE_HPP
+
+#include <algorithm>
+#include <iostream>
+
+#include "hash.hpp"
+
+namespace poplar {
+
+// Set-associative cache from key fingerprints to the positions where the keys are found, i.e., pairs of the
+// node ID and the offset in the key at which the label of the node starts. Each set of num_ways entries fits
+// in a cache line, and the entries are replaced in FIFO order within the set.
+class front_cache {
+  public:
+    static constexpr uint32_t num_ways = 4;
+    static constexpr uint32_t offset_bits = 24;
+    static constexpr uint64_t max_node_id = (1ULL << (64 - offset_bits)) - 1;
+    static constexpr uint64_t max_offset = (1ULL << offset_bits) - 1;
+
+  public:
+    front_cache() = default;
+
+    // Allocates 2**set_bits sets.
+    explicit front_cache(uint32_t set_bits) : sets_(1ULL << set_bits), set_mask_{(1ULL << set_bits) - 1} {}
+
+    ~front_cache() = default;
+
+    bool enabled() const {
+        return !sets_.empty();
+    }
+
+    // Gets the fingerprint of the key, which is never zero since the lowest bit is set. The set is chosen by the
+    // other bits.
+    static uint64_t fingerprint(const char_range& key) {
+        return hash::hash_bytes(key.begin, key.length()) | 1;
+    }
+
+    // Searches the given fingerprint and sets the position if cached.
+    bool find(uint64_t fp, uint64_t& node_id, uint64_t& offset) const {
+        const cache_set& set = sets_[set_id_(fp)];
+        for (uint32_t i = 0; i < num_ways; ++i) {
+            if (set.fps[i] == fp) {
+                node_id = set.positions[i] >> offset_bits;
+                offset = set.positions[i] & max_offset;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insert(uint64_t fp, uint64_t node_id, uint64_t offset) {
+        if (max_node_id < node_id or max_offset < offset) {
+            return;
+        }
+        cache_set& set = sets_[set_id_(fp)];
+        for (uint32_t i = num_ways - 1; i > 0; --i) {
+            set.fps[i] = set.fps[i - 1];
+            set.positions[i] = set.positions[i - 1];
+        }
+        set.fps[0] = fp;
+        set.positions[0] = (node_id << offset_bits) | offset;
+    }
+
+    // Invalidates all the entries, e.g., when the node IDs are changed.
+    void clear() {
+        std::fill(sets_.begin(), sets_.end(), cache_set{});
+    }
+
+    void count(bool hit) {
+        ++(hit ? num_hits_ : num_misses_);
+    }
+    uint64_t num_hits() const {
+        return num_hits_;
+    }
+    uint64_t num_misses() const {
+        return num_misses_;
+    }
+    double hit_rate() const {
+        const uint64_t num_lookups = num_hits_ + num_misses_;
+        return num_lookups == 0 ? 0.0 : double(num_hits_) / num_lookups;
+    }
+
+    // Gets the number of the cached entries.
+    uint64_t num_entries() const {
+        uint64_t num = 0;
+        for (const cache_set& set : sets_) {
+            for (uint32_t i = 0; i < num_ways; ++i) {
+                num += set.fps[i] != 0;
+            }
+        }
+        return num;
+    }
+
+    uint64_t alloc_bytes() const {
+        return sets_.capacity() * sizeof(cache_set);
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "front_cache");
+        show_stat(os, indent, "num_sets", sets_.size());
+        show_stat(os, indent, "num_entries", num_entries());
+        show_stat(os, indent, "num_hits", num_hits_);
+        show_stat(os, indent, "num_misses", num_misses_);
+        show_stat(os, indent, "hit_rate", hit_rate());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+    }
+
+    front_cache(const front_cache&) = delete;
+    front_cache& operator=(const front_cache&) = delete;
+
+    front_cache(front_cache&&) noexcept = default;
+    front_cache& operator=(front_cache&&) noexcept = default;
+
+  private:
+    struct alignas(64) cache_set {
+        uint64_t fps[num_ways] = {};  // zero indicates to be empty
+        uint64_t positions[num_ways] = {};  // (node_id << offset_bits) | offset
+    };
+
+    std::vector<cache_set> sets_;
+    uint64_t set_mask_ = 0;
+    uint64_t num_hits_ = 0;
+    uint64_t num_misses_ = 0;
+
+    uint64_t set_id_(uint64_t fp) const {
+        return (fp >> 1) & set_mask_;
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_FRONT_CACHE_HPP
@@ -51,6 +51,27 @@ struct vigna_hasher {
     uint64_t seed_ = 0x9e3779b97f4a7c15ULL;
 };
 
+// Maps a hash value into [0, n) with the multiply-high technique by Lemire, which needs no power of two n.
+inline uint64_t fast_range(uint64_t x, uint64_t n) {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(x) * n) >> 64);
+}
+
+// Hashes a byte string by mixing each 8-byte word with splitmix64.
+inline uint64_t hash_bytes(const uint8_t* bytes, uint64_t n, uint64_t seed = 0x9e3779b97f4a7c15ULL) {
+    uint64_t h = seed ^ n;
+    for (; 8 <= n; bytes += 8, n -= 8) {
+        uint64_t x;
+        std::memcpy(&x, bytes, 8);
+        h = vigna_hasher::hash(h ^ x);
+    }
+    if (n != 0) {
+        uint64_t x = 0;
+        std::memcpy(&x, bytes, n);
+        h = vigna_hasher::hash(h ^ x);
+    }
+    return h;
+}
+
 }  // namespace poplar::hash
 
 #endif  // POPLAR_TRIE_HASH_HPP
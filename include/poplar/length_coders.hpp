@@ -0,0 +1,257 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_LENGTH_CODERS_HPP
+#define POPLAR_TRIE_LENGTH_CODERS_HPP
+
+#include <algorithm>
+#include <memory>
+
+#include "bit_tools.hpp"
+#include "vbyte.hpp"
+
+namespace poplar {
+
+// Length coders define how the compact NLMs lay out the records of a chunk, where each record is a label
+// followed by its value. Every coder provides the following static functions:
+//  - size(lengths, n) gets the bytes of the chunk of n records of the given lengths;
+//  - encode(chunk, lengths, n, payloads) writes the lengths and sets the positions where the records go;
+//  - get(chunk, n, i) gets the i-th record;
+//  - decode(chunk, n, records) gets all the records;
+//  - insert(chunk, n, i, length, record) rebuilds the chunk with a new i-th record of the given length, sets
+//    the pointer to the record to be written, and returns the increase of the bytes;
+//  - estimate_size(num_records, payload_bytes, chunk_size) estimates the total bytes of the chunks.
+
+// Each record is preceded by vbyte(length), so get() walks the preceding records.
+struct vbyte_length_coder {
+    static constexpr auto name = "vbyte";
+
+    static uint64_t size(const uint64_t* lengths, uint64_t n) {
+        uint64_t bytes = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            bytes += vbyte::size(lengths[i]) + lengths[i];
+        }
+        return bytes;
+    }
+
+    static void encode(uint8_t* chunk, const uint64_t* lengths, uint64_t n, uint8_t** payloads) {
+        for (uint64_t i = 0; i < n; ++i) {
+            chunk += vbyte::encode(chunk, lengths[i]);
+            payloads[i] = chunk;
+            chunk += lengths[i];
+        }
+    }
+
+    static char_range get(const uint8_t* chunk, uint64_t, uint64_t i) {
+        chunk = vbyte::skip(chunk, i);
+        uint64_t length = 0;
+        chunk += vbyte::decode(chunk, length);
+        return {chunk, chunk + length};
+    }
+
+    static void decode(const uint8_t* chunk, uint64_t n, char_range* records) {
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t length = 0;
+            chunk += vbyte::decode(chunk, length);
+            records[i] = {chunk, chunk + length};
+            chunk += length;
+        }
+    }
+
+    // The records are moved in bulk since the preceding and following ones are consecutive.
+    static uint64_t insert(std::unique_ptr<uint8_t[]>& chunk, uint64_t n, uint64_t i, uint64_t length,
+                           uint8_t*& record) {
+        const uint8_t* front_end = skip_(chunk.get(), i);
+        const uint64_t front_size = static_cast<uint64_t>(front_end - chunk.get());
+        const uint64_t back_size = static_cast<uint64_t>(skip_(front_end, n - i) - front_end);
+        const uint64_t new_size = vbyte::size(length) + length;
+
+        auto new_chunk = std::make_unique<uint8_t[]>(front_size + new_size + back_size);
+        uint8_t* ptr = new_chunk.get();
+
+        copy_bytes(ptr, chunk.get(), front_size);
+        ptr += front_size;
+        ptr += vbyte::encode(ptr, length);
+        record = ptr;
+        copy_bytes(ptr + length, front_end, back_size);
+
+        chunk = std::move(new_chunk);
+        return new_size;
+    }
+
+    // The lengths are assumed to fit in one vbyte.
+    static uint64_t estimate_size(uint64_t num_records, uint64_t payload_bytes, uint64_t) {
+        return num_records + payload_bytes;
+    }
+
+  private:
+    static const uint8_t* skip_(const uint8_t* chunk, uint64_t n) {
+        return n == 0 ? chunk : vbyte::skip(chunk, n);
+    }
+};
+
+// The chunk starts with a header of the end offsets of the records (i.e., prefix sums of the lengths), so
+// get() takes constant time. The offsets are packed in the minimum number of UnitBits-bit units for the
+// chunk, whose number is written in the first byte.
+template <uint32_t UnitBits>
+struct offset_length_coder {
+    static_assert(UnitBits == 4 or UnitBits == 8);
+
+    static constexpr auto name = UnitBits == 4 ? "nibble" : "fixed";
+
+    static uint64_t size(const uint64_t* lengths, uint64_t n) {
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            total += lengths[i];
+        }
+        return header_size_(n, units_for_(total)) + total;
+    }
+
+    static void encode(uint8_t* chunk, const uint64_t* lengths, uint64_t n, uint8_t** payloads) {
+        uint64_t total = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            total += lengths[i];
+        }
+
+        const uint32_t units = units_for_(total);
+        const uint64_t header_size = header_size_(n, units);
+        std::fill(chunk, chunk + header_size, 0);
+        chunk[0] = static_cast<uint8_t>(units);
+
+        uint64_t offset = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            payloads[i] = chunk + header_size + offset;
+            offset += lengths[i];
+            set_offset_(chunk + 1, units, i, offset);
+        }
+    }
+
+    static char_range get(const uint8_t* chunk, uint64_t n, uint64_t i) {
+        assert(i < n);
+        const uint32_t units = chunk[0];
+        const uint8_t* payloads = chunk + header_size_(n, units);
+        const uint64_t begin = i == 0 ? 0 : get_offset_(chunk + 1, units, i - 1);
+        return {payloads + begin, payloads + get_offset_(chunk + 1, units, i)};
+    }
+
+    static void decode(const uint8_t* chunk, uint64_t n, char_range* records) {
+        const uint32_t units = chunk[0];
+        const uint8_t* payloads = chunk + header_size_(n, units);
+        uint64_t begin = 0;
+        for (uint64_t i = 0; i < n; ++i) {
+            const uint64_t end = get_offset_(chunk + 1, units, i);
+            records[i] = {payloads + begin, payloads + end};
+            begin = end;
+        }
+    }
+
+    // The chunk consists of at most 64 records since it is used for compact_bonsai_nlm.
+    static uint64_t insert(std::unique_ptr<uint8_t[]>& chunk, uint64_t n, uint64_t i, uint64_t length,
+                           uint8_t*& record) {
+        assert(n < 64);
+
+        char_range records[64];
+        uint64_t lengths[64];
+        uint8_t* payloads[64];
+
+        if (n != 0) {
+            decode(chunk.get(), n, records);
+        }
+        for (uint64_t j = 0; j < n; ++j) {
+            lengths[j] = records[j].length();
+        }
+        const uint64_t old_size = n == 0 ? 0 : size(lengths, n);
+
+        for (uint64_t j = n; j > i; --j) {
+            records[j] = records[j - 1];
+            lengths[j] = lengths[j - 1];
+        }
+        lengths[i] = length;
+
+        const uint64_t new_size = size(lengths, n + 1);
+        auto new_chunk = std::make_unique<uint8_t[]>(new_size);
+        encode(new_chunk.get(), lengths, n + 1, payloads);
+
+        for (uint64_t j = 0; j <= n; ++j) {
+            if (j != i) {
+                copy_bytes(payloads[j], records[j].begin, lengths[j]);
+            }
+        }
+
+        chunk = std::move(new_chunk);
+        record = payloads[i];
+        return new_size - old_size;
+    }
+
+    static uint64_t estimate_size(uint64_t num_records, uint64_t payload_bytes, uint64_t chunk_size) {
+        if (num_records == 0) {
+            return 0;
+        }
+        const uint64_t num_chunks = (num_records + chunk_size - 1) / chunk_size;
+        const uint32_t units = units_for_((payload_bytes + num_chunks - 1) / num_chunks);
+        return num_chunks + (num_records * units * UnitBits + 7) / 8 + payload_bytes;
+    }
+
+  private:
+    static uint32_t units_for_(uint64_t total) {
+        const uint32_t bits = std::max(1U, bit_tools::ceil_log2(total + 1));
+        assert(bits <= 56);
+        return (bits + UnitBits - 1) / UnitBits;
+    }
+
+    static uint64_t header_size_(uint64_t n, uint32_t units) {
+        return 1 + (n * units * UnitBits + 7) / 8;
+    }
+
+    static uint64_t get_offset_(const uint8_t* offsets, uint32_t units, uint64_t i) {
+        const uint64_t pos = i * units * UnitBits;
+        const uint8_t* ptr = offsets + pos / 8;
+        const uint32_t shift = pos % 8;
+        const uint32_t num_bytes = (shift + units * UnitBits + 7) / 8;
+
+        uint64_t x = 0;
+        for (uint32_t j = 0; j < num_bytes; ++j) {
+            x |= static_cast<uint64_t>(ptr[j]) << (j * 8);
+        }
+        return (x >> shift) & ((1ULL << (units * UnitBits)) - 1);
+    }
+
+    static void set_offset_(uint8_t* offsets, uint32_t units, uint64_t i, uint64_t x) {
+        const uint64_t pos = i * units * UnitBits;
+        uint8_t* ptr = offsets + pos / 8;
+        const uint32_t shift = pos % 8;
+        const uint32_t num_bytes = (shift + units * UnitBits + 7) / 8;
+
+        x <<= shift;
+        for (uint32_t j = 0; j < num_bytes; ++j) {
+            ptr[j] |= static_cast<uint8_t>(x >> (j * 8));
+        }
+    }
+};
+
+using nibble_length_coder = offset_length_coder<4>;
+using fixed_length_coder = offset_length_coder<8>;
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_LENGTH_CODERS_HPP
@@ -24,11 +24,18 @@
 #ifndef POPLAR_TRIE_MAP_HPP
 #define POPLAR_TRIE_MAP_HPP
 
+#include <algorithm>
 #include <array>
 #include <iostream>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
 
 #include "bit_tools.hpp"
+#include "bit_vector.hpp"
+#include "compact_vector.hpp"
 #include "exception.hpp"
+#include "front_cache.hpp"
 
 namespace poplar {
 
@@ -42,10 +49,22 @@ class map {
   public:
     using this_type = map<Trie, NLM>;
     using trie_type = Trie;
+    using nlm_type = NLM;
     using value_type = typename NLM::value_type;
+    using value_pointer = typename NLM::value_pointer;
+    using const_value_pointer = typename NLM::const_value_pointer;
 
     static constexpr auto trie_type_id = Trie::trie_type_id;
     static constexpr uint32_t min_capa_bits = Trie::min_capa_bits;
+    static constexpr uint64_t nil_id = Trie::nil_id;
+
+    // The length of the keys given by the NLM, which are then stored without the terminator and may contain any
+    // byte, or 0 for the null-terminated keys.
+    static constexpr uint32_t key_bytes = NLM::key_bytes;
+
+    // The range of lambda chosen by the auto-tuning.
+    static constexpr uint64_t min_auto_lambda = 4;
+    static constexpr uint64_t max_auto_lambda = 1024;
 
   public:
     // Generic constructor.
@@ -56,12 +75,46 @@ class map {
     explicit map(uint32_t capa_bits, uint64_t lambda = 32) {
         POPLAR_THROW_IF(!is_power2(lambda), "lambda must be a power of 2.");
 
-        is_ready_ = true;
         lambda_ = lambda;
-        hash_trie_ = Trie{capa_bits, 8 + bit_tools::ceil_log2(lambda_)};
-        label_store_ = NLM{hash_trie_.capa_bits()};
-        codes_.fill(UINT8_MAX);
-        codes_[0] = static_cast<uint8_t>(num_codes_++);  // terminator
+        reset_(capa_bits);
+    }
+
+    // Class constructor with the alphabet learned from the sample keys. The characters are given the codes in
+    // the decreasing order of the frequencies, and the codes take only the bits needed for the alphabet, which
+    // narrows the symbols of the hash table. When a character out of the alphabet overflows the codes, the map
+    // is rebuilt with one more bit within update(), which takes time linear in the size and invalidates all the
+    // value pointers and the key IDs returned before, even those of the stable value containers.
+    map(uint32_t capa_bits, uint64_t lambda, const std::vector<std::string>& sample) {
+        static_assert(key_bytes == 0, "The fixed-length keys take every byte as the code.");
+        POPLAR_THROW_IF(!is_power2(lambda), "lambda must be a power of 2.");
+
+        std::array<uint64_t, 256> freqs = {};
+        for (const std::string& key : sample) {
+            for (char c : key) {
+                ++freqs[static_cast<uint8_t>(c)];
+            }
+        }
+        POPLAR_THROW_IF(freqs[0] != 0, "key must not contain '\\0'.");
+
+        std::array<uint8_t, 256> chars;
+        for (uint32_t c = 0; c < 256; ++c) {
+            chars[c] = static_cast<uint8_t>(c);
+        }
+        std::stable_sort(chars.begin(), chars.end(), [&](uint8_t a, uint8_t b) { return freqs[a] > freqs[b]; });
+
+        lambda_ = lambda;
+        is_ready_ = true;
+        init_codes_();
+        for (uint8_t c : chars) {
+            if (freqs[c] == 0 or num_codes_ + 1 == UINT8_MAX) {
+                break;
+            }
+            chars_[num_codes_] = c;
+            codes_[c] = static_cast<uint8_t>(num_codes_++);
+        }
+        // One more code is for the step symbol.
+        code_bits_ = std::max(1U, bit_tools::ceil_log2(num_codes_ + 1));
+        reset_(capa_bits);
     }
 
     // Generic destructor.
@@ -69,66 +122,62 @@ class map {
 
     // Searches the given key and returns the value pointer if registered;
     // otherwise returns nullptr.
-    const value_type* find(const std::string& key) const {
-        return find(make_char_range(key));
+    const_value_pointer find(const std::string& key) const {
+        return find(make_key_range_(key));
     }
-    const value_type* find(char_range key) const {
-        POPLAR_THROW_IF(key.empty(), "key must be a non-empty string.");
-        POPLAR_THROW_IF(*(key.end - 1) != '\0', "The last character of key must be the null terminator.");
+    const_value_pointer find(char_range key) const {
+        check_key_(key);
 
         if (!is_ready_ or hash_trie_.size() == 0) {
             return nullptr;
         }
 
-        auto node_id = hash_trie_.get_root();
+        if (!cache_.enabled()) {
+            uint64_t node_id = 0, offset = 0;
+            return find_(key, node_id, offset);
+        }
 
-        while (!key.empty()) {
-            auto [vptr, match] = label_store_.compare(node_id, key);
+        const uint64_t fp = front_cache::fingerprint(key);
+        uint64_t node_id = 0, offset = 0;
+
+        if (cache_.find(fp, node_id, offset) and offset <= key.length()) {
+            // The rest of the key is compared with the label, which rejects most but not all of the colliding
+            // fingerprints.
+            auto vptr = label_store_.compare(node_id, char_range{key.begin + offset, key.end}).first;
             if (vptr != nullptr) {
+                cache_.count(true);
                 return vptr;
             }
-
-            key.begin += match;
-
-            while (lambda_ <= match) {
-                node_id = hash_trie_.find_child(node_id, step_symb);
-                if (node_id == nil_id) {
-                    return nullptr;
-                }
-                match -= lambda_;
-            }
-
-            if (codes_[*key.begin] == UINT8_MAX) {
-                // Detecting an useless character
-                return nullptr;
-            }
-
-            node_id = hash_trie_.find_child(node_id, make_symb_(*key.begin, match));
-            if (node_id == nil_id) {
-                return nullptr;
-            }
-
-            ++key.begin;
         }
+        cache_.count(false);
 
-        return label_store_.compare(node_id, key).first;
+        auto vptr = find_(key, node_id, offset);
+        if (vptr != nullptr) {
+            cache_.insert(fp, node_id, offset);
+        }
+        return vptr;
     }
 
     // Inserts the given key and returns the value pointer.
-    value_type* update(const std::string& key) {
-        return update(make_char_range(key));
+    value_pointer update(const std::string& key) {
+        return update(make_key_range_(key));
     }
-    value_type* update(char_range key) {
-        POPLAR_THROW_IF(key.empty(), "key must be a non-empty string.");
-        POPLAR_THROW_IF(*(key.end - 1) != '\0', "The last character of key must be the null terminator.");
+    value_pointer update(char_range key) {
+        check_key_(key);
+
+        const char_range whole_key = key;
+
+        if (auto_lambda_.enabled) {
+            check_lambda_();
+        }
 
         if (hash_trie_.size() == 0) {
             if (!is_ready_) {
-                *this = this_type{0};
+                reset_(0);
             }
             // The first insertion
             ++size_;
-            hash_trie_.add_root();
+            add_root_();
 
             if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
                 // assert(hash_trie_.get_root() == label_store_.size());
@@ -146,14 +195,17 @@ class map {
         while (!key.empty()) {
             auto [vptr, match] = label_store_.compare(node_id, key);
             if (vptr != nullptr) {
-                return const_cast<value_type*>(vptr);
+                return to_mutable_(vptr);
             }
 
             key.begin += match;
+            const uint64_t branch = match;
 
             while (lambda_ <= match) {
-                if (hash_trie_.add_child(node_id, step_symb)) {
+                const uint64_t parent_id = node_id;
+                if (hash_trie_.add_child(node_id, step_symb_())) {
                     expand_if_needed_(node_id);
+                    set_parent_(node_id, parent_id, step_symb_());
 #ifdef POPLAR_EXTRA_STATS
                     ++num_steps_;
 #endif
@@ -165,17 +217,31 @@ class map {
                 match -= lambda_;
             }
 
-            if (codes_[*key.begin] == UINT8_MAX) {
+            if (!is_coded_(*key.begin)) {
+                if (num_codes_ == step_symb_() and code_bits_ < 8) {
+                    // The codes are exhausted
+                    widen_codes_();
+                    return update(whole_key);
+                }
                 // Update table
+                chars_[num_codes_] = *key.begin;
                 codes_[*key.begin] = static_cast<uint8_t>(num_codes_++);
                 POPLAR_THROW_IF(UINT8_MAX == num_codes_, "");
             }
 
-            if (hash_trie_.add_child(node_id, make_symb_(*key.begin, match))) {
+            const uint64_t parent_id = node_id;
+            const uint64_t symb = make_symb_(*key.begin, match);
+            if (hash_trie_.add_child(node_id, symb)) {
                 expand_if_needed_(node_id);
+                set_parent_(node_id, parent_id, symb);
                 ++key.begin;
                 ++size_;
 
+                if (auto_lambda_.enabled) {
+                    ++auto_lambda_.num_branches;
+                    auto_lambda_.sum_branches += branch;
+                }
+
                 if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
                     assert(node_id == label_store_.size());
                     return label_store_.append(key);
@@ -191,7 +257,263 @@ class map {
         }
 
         auto vptr = label_store_.compare(node_id, key).first;
-        return vptr ? const_cast<value_type*>(vptr) : nullptr;
+        return vptr ? to_mutable_(vptr) : nullptr;
+    }
+
+    // Gets the ID of the given key in [0, size()), or nil_id if not registered. The IDs are given to the keys
+    // in the insertion order and never change unless the learned codes are widened. They are supported only by
+    // the FK-hash tries, since the bonsai tries move the nodes at every resize, and need enable_key_ids().
+    uint64_t find_id(const std::string& key) const {
+        return find_id(make_key_range_(key));
+    }
+    uint64_t find_id(char_range key) const {
+        static_assert(trie_type_id == trie_type_ids::FKHASH_TRIE, "The key IDs need an FK-hash trie.");
+        POPLAR_THROW_IF(!keeps_parents_, "enable_key_ids() must be called before.");
+        check_key_(key);
+
+        if (!is_ready_ or hash_trie_.size() == 0) {
+            return nil_id;
+        }
+        uint64_t node_id = 0, offset = 0;
+        return find_(key, node_id, offset) != nullptr ? key_rank_(node_id) : nil_id;
+    }
+
+    // Keeps the parent of each node so that extract_key() can walk up the trie, which takes
+    // (capa_bits + symb_bits) bits per slot, and whether each node stores a key so that the nodes are mapped to
+    // the dense key IDs, which takes about 1.125 bits per node.
+    void enable_key_ids() {
+        static_assert(trie_type_id == trie_type_ids::FKHASH_TRIE, "The key IDs need an FK-hash trie.");
+        POPLAR_THROW_IF(auto_lambda_.enabled, "Key IDs cannot be used with the auto-tuning of lambda.");
+
+        if (keeps_parents_) {
+            return;
+        }
+        keeps_parents_ = true;
+        if (!is_ready_) {
+            return;
+        }
+        reserve_parents_();
+        hash_trie_.for_each_edge([&](uint64_t parent, uint64_t symb, uint64_t child) {  //
+            parents_.set(child, (parent << hash_trie_.symb_bits()) | symb);
+        });
+
+        // The step nodes store no key.
+        for (uint64_t node_id = 0; node_id < hash_trie_.size(); ++node_id) {
+            append_key_bit_(node_id == hash_trie_.get_root() or get_parent_and_symb_(node_id).second != step_symb_());
+        }
+    }
+
+    // Restores the key of the given ID into out without the terminator, by walking up the trie and collecting
+    // the prefixes of the labels of the ancestors. Returns false if the ID is not of a key.
+    bool extract_key(uint64_t id, std::string& out) const {
+        static_assert(trie_type_id == trie_type_ids::FKHASH_TRIE, "The key IDs need an FK-hash trie.");
+        static_assert(key_bytes == 0, "The labels of the fixed-length keys need the depths to be restored.");
+        POPLAR_THROW_IF(!keeps_parents_, "enable_key_ids() must be called before.");
+
+        if (!is_ready_ or size_ <= id) {
+            return false;
+        }
+
+        const uint64_t root_id = hash_trie_.get_root();
+        const uint64_t node_id = key_select_(id);
+        auto [parent_id, symb] = get_parent_and_symb_(node_id);
+
+        // The key is built in the reverse order. The node reached by the terminator has no label.
+        char_range label = {};
+        if (node_id == root_id or chars_[symb & step_symb_()] != '\0') {
+            label = label_store_.get_label(node_id);
+        }
+        out.assign(std::make_reverse_iterator(label.end), std::make_reverse_iterator(label.begin));
+
+        for (uint64_t child_id = node_id; child_id != root_id;) {
+            // The step nodes consume lambda characters of the label of the nearest non-step ancestor each.
+            uint64_t offset = 0;
+            auto [grand_id, parent_symb] = get_parent_and_symb_(parent_id);
+            while (parent_symb == step_symb_() and grand_id != nil_id) {
+                offset += lambda_;
+                parent_id = grand_id;
+                std::tie(grand_id, parent_symb) = get_parent_and_symb_(parent_id);
+            }
+
+            const uint8_t c = chars_[symb & step_symb_()];
+            if (c != '\0') {
+                out.push_back(static_cast<char>(c));
+            }
+            label = label_store_.get_label(parent_id);
+            const uint64_t length = offset + (symb >> code_bits_);
+            assert(length <= label.length());
+            out.append(std::make_reverse_iterator(label.begin + length), std::make_reverse_iterator(label.begin));
+
+            child_id = parent_id;
+            parent_id = grand_id;
+            symb = parent_symb;
+        }
+
+        std::reverse(out.begin(), out.end());
+        return true;
+    }
+
+    // Inserts the keys of the other map. For a key registered in both maps, merge_fn(value, other_value) combines
+    // the values into value; otherwise the value is copied. If the other is also a map, no key is restored: if
+    // this map is empty, its nodes are copied one by one with the labels, taking its lambda and codes; otherwise,
+    // both tries are walked together and only the parts of the labels missing in this trie are added as nodes.
+    // For the other containers, the keys are enumerated and inserted by update().
+    template <typename OtherMap, typename MergeFn>
+    void merge(const OtherMap& other, MergeFn merge_fn) {
+        POPLAR_THROW_IF(static_cast<const void*>(this) == static_cast<const void*>(&other),
+                        "A map cannot be merged with itself.");
+
+        if constexpr (is_map_(static_cast<const OtherMap*>(nullptr)) and key_bytes == 0 and OtherMap::key_bytes == 0) {
+            if (size_ == 0) {
+                copy_nodes_(other);
+            } else if (other.size() != 0) {
+                merge_nodes_(other, merge_fn);
+            }
+            return;
+        }
+        if (size_ == 0) {
+            reserve(other.size(), 0);
+        }
+
+        std::string key;
+        other.enumerate([&](std::string_view key_view, const auto& other_value) {
+            key.assign(key_view);
+            const uint64_t size = size_;
+            auto vptr = update(key);
+
+            if (size == size_) {
+                value_type value = *vptr;
+                merge_fn(value, other_value);
+                *vptr = std::move(value);
+            } else {
+                *vptr = other_value;
+            }
+        });
+    }
+    // Same as above but the values of the other map overwrite.
+    template <typename OtherMap>
+    void merge(const OtherMap& other) {
+        merge(other, [](value_type& value, const auto& other_value) { value = other_value; });
+    }
+
+    // Calls fn(key, value) for every registered key in no particular order, where key is given as
+    // std::string_view without the terminator.
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        enumerate_([&](std::string_view key, const_value_pointer vptr) { fn(key, *vptr); });
+    }
+    // Same as above but the values can be modified.
+    template <typename Fn>
+    void enumerate(Fn fn) {
+        enumerate_([&](std::string_view key, const_value_pointer vptr) { fn(key, *to_mutable_(vptr)); });
+    }
+
+    // Prepares the hash table so that num_keys keys of avg_key_len bytes on average
+    // can be inserted without expansion. The table is never shrunk.
+    void reserve(uint64_t num_keys, uint64_t avg_key_len) {
+        uint32_t capa_bits = estimate_capa_bits_(num_keys, avg_key_len, lambda_);
+
+        if (!is_ready_ or hash_trie_.size() == 0) {
+            if (!is_ready_ or hash_trie_.capa_bits() < capa_bits) {
+                reset_(capa_bits);
+            }
+            return;
+        }
+        if (hash_trie_.capa_bits() < capa_bits) {
+            resize_(capa_bits);
+        }
+    }
+
+    // Shrinks the hash table to the smallest capacity within the maximum load factor and
+    // releases the unused memory, e.g., after a bulk load. Returns the number of reclaimed bytes.
+    uint64_t shrink_to_fit() {
+        if (!is_ready_) {
+            return 0;
+        }
+
+        const uint64_t bytes = alloc_bytes();
+
+        if (hash_trie_.size() == 0) {
+            reset_(0);
+        } else {
+            const uint32_t capa_bits = capa_bits_for_(hash_trie_.size());
+            if (capa_bits < hash_trie_.capa_bits()) {
+                resize_(capa_bits);
+            }
+            label_store_.shrink_to_fit();
+        }
+
+        return bytes > alloc_bytes() ? bytes - alloc_bytes() : 0;
+    }
+
+    // Estimates alloc_bytes() after inserting num_keys keys of avg_key_len bytes on average.
+    static uint64_t estimate_alloc_bytes(uint64_t num_keys, uint64_t avg_key_len, uint64_t lambda = 32) {
+        POPLAR_THROW_IF(!is_power2(lambda), "lambda must be a power of 2.");
+
+        uint32_t capa_bits = std::max(min_capa_bits, estimate_capa_bits_(num_keys, avg_key_len, lambda));
+        uint32_t symb_bits = 8 + bit_tools::ceil_log2(lambda);
+
+        uint64_t bytes = 0;
+        bytes += Trie::estimate_alloc_bytes(capa_bits, symb_bits);
+        bytes += NLM::estimate_alloc_bytes(capa_bits, num_keys, num_keys * estimate_label_length_(avg_key_len));
+        bytes += sizeof(codes_);
+        return bytes;
+    }
+
+    // Enables the front cache of 2**set_bits sets, which remembers where the recently found keys are so that
+    // find() skips the trie traversal for frequently searched keys. A cached key is identified by its 63-bit
+    // fingerprint and the rest of the key compared with the label, so another key of the same fingerprint whose
+    // rest matches the label at the cached offset gets a false hit, with a probability of about 2**-63 per pair
+    // of keys. Since find() then updates the cache, concurrent calls of find() are not safe.
+    void enable_cache(uint32_t set_bits) {
+        cache_ = front_cache{set_bits};
+    }
+    void disable_cache() {
+        cache_ = front_cache{};
+    }
+    const front_cache& get_cache() const {
+        return cache_;
+    }
+
+    // Enables the auto-tuning of lambda. After num_samples keys are inserted, lambda is chosen from the trie so
+    // as to minimize the projected memory, where the largest one within 1% of the minimum is preferred since the
+    // step nodes cost hash lookups. The trie is checked again at the expansions of the hash table if the depths
+    // at which the new keys branch in the labels drift. Whenever lambda is changed, the map is rebuilt within
+    // update() in time linear in the size, like an expansion, which invalidates the value pointers and the node
+    // IDs. So it is refused for the stable values and the key IDs. Choosing lambda temporarily takes about 16
+    // bytes for each edge branching min_auto_lambda or more characters into a label and 32 bytes for each step
+    // node, which is not included in estimate_alloc_bytes().
+    void enable_auto_lambda(uint64_t num_samples = 1ULL << 14) {
+        POPLAR_THROW_IF(NLM::stable_values, "The auto-tuning of lambda would move the stable values.");
+        POPLAR_THROW_IF(keeps_parents_, "The auto-tuning of lambda would change the key IDs.");
+
+        auto_lambda_ = lambda_tuner{};
+        auto_lambda_.enabled = true;
+        auto_lambda_.num_samples = std::max<uint64_t>(1, num_samples);
+    }
+    void disable_auto_lambda() {
+        auto_lambda_ = lambda_tuner{};
+    }
+    // Chooses lambda from the trie of the sample keys as above, e.g., before a bulk load. If the map is not
+    // empty and lambda is changed, the map is rebuilt, which invalidates the value pointers and the node IDs.
+    // So it is refused for the stable values and the key IDs unless the map is empty.
+    void tune_lambda(const std::vector<std::string>& sample) {
+        POPLAR_THROW_IF(size_ != 0 and NLM::stable_values, "The tuning of lambda would move the stable values.");
+        POPLAR_THROW_IF(size_ != 0 and keeps_parents_, "The tuning of lambda would change the key IDs.");
+
+        this_type sample_map{0, max_auto_lambda};
+        sample_map.auto_lambda_.enabled = true;  // only to observe the branches
+        sample_map.auto_lambda_.num_samples = UINT64_MAX;
+        for (const std::string& key : sample) {
+            sample_map.update(key);
+        }
+
+        auto_lambda_.tuned = true;
+        auto_lambda_.capa_size = hash_trie_.capa_size();
+        auto_lambda_.tuned_mean = sample_map.auto_lambda_.current_mean();
+        auto_lambda_.num_branches = auto_lambda_.sum_branches = 0;
+        ++auto_lambda_.num_tunes;
+        set_lambda_(sample_map.choose_lambda_());
     }
 
     // Gets the number of registered keys.
@@ -202,6 +524,21 @@ class map {
     uint64_t capa_size() const {
         return hash_trie_.capa_size();
     }
+    // Gets how full the hash table is, where it is expanded at 1.0.
+    double fill_rate() const {
+        return hash_trie_.max_size() == 0 ? 0.0 : double(hash_trie_.size()) / hash_trie_.max_size();
+    }
+    uint64_t lambda() const {
+        return lambda_;
+    }
+    // Gets how many times lambda has been tuned.
+    uint64_t num_lambda_tunes() const {
+        return auto_lambda_.num_tunes;
+    }
+    // Gets the bits of the character codes.
+    uint32_t code_bits() const {
+        return code_bits_;
+    }
 #ifdef POPLAR_EXTRA_STATS
     double rate_steps() const {
         return double(num_steps_) / size_;
@@ -215,6 +552,11 @@ class map {
         bytes += hash_trie_.alloc_bytes();
         bytes += label_store_.alloc_bytes();
         bytes += codes_.size();
+        bytes += chars_.size();
+        bytes += cache_.alloc_bytes();
+        bytes += parents_.alloc_bytes();
+        bytes += key_bits_.alloc_bytes();
+        bytes += key_ranks_.capacity() * sizeof(uint64_t);
         return bytes;
     }
 
@@ -222,6 +564,10 @@ class map {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "map");
         show_stat(os, indent, "lambda", lambda_);
+        if (auto_lambda_.enabled) {
+            show_stat(os, indent, "num_lambda_tunes", auto_lambda_.num_tunes);
+        }
+        show_stat(os, indent, "code_bits", code_bits_);
         show_stat(os, indent, "size", size());
         show_stat(os, indent, "alloc_bytes", alloc_bytes());
 #ifdef POPLAR_EXTRA_STATS
@@ -231,6 +577,10 @@ class map {
         hash_trie_.show_stats(os, n + 1);
         show_member(os, indent, "label_store_");
         label_store_.show_stats(os, n + 1);
+        if (cache_.enabled()) {
+            show_member(os, indent, "cache_");
+            cache_.show_stats(os, n + 1);
+        }
     }
 
     map(const map&) = delete;
@@ -240,8 +590,26 @@ class map {
     map& operator=(map&&) noexcept = default;
 
   private:
-    static constexpr uint64_t nil_id = Trie::nil_id;
-    static constexpr uint64_t step_symb = UINT8_MAX;  // (UINT8_MAX, 0)
+    template <typename, typename>
+    friend class map;
+
+    // Observes at which depths of the labels the new keys branch.
+    struct lambda_tuner {
+        static constexpr uint64_t min_branches = 1024;  // to detect the drift
+
+        bool enabled = false;
+        bool tuned = false;
+        uint64_t num_samples = 0;
+        uint64_t capa_size = 0;  // at the last check
+        uint64_t num_branches = 0;  // since the last check
+        uint64_t sum_branches = 0;
+        double tuned_mean = 0.0;  // of the branches at the last tuning
+        uint64_t num_tunes = 0;
+
+        double current_mean() const {
+            return num_branches == 0 ? 0.0 : double(sum_branches) / num_branches;
+        }
+    };
 
     bool is_ready_ = false;
     uint64_t lambda_ = 32;
@@ -249,18 +617,787 @@ class map {
     Trie hash_trie_;
     NLM label_store_;
     std::array<uint8_t, 256> codes_ = {};
+    std::array<uint8_t, 256> chars_ = {};  // inverse of codes_
     uint32_t num_codes_ = 0;
+    uint32_t code_bits_ = 8;
     uint64_t size_ = 0;
+    mutable front_cache cache_;
+    bool keeps_parents_ = false;
+    compact_vector parents_;  // (parent << symb_bits) | symb of each node for the FK-hash tries
+    bit_vector key_bits_;  // whether each node stores a key for the FK-hash tries
+    std::vector<uint64_t> key_ranks_;  // number of the keys before every key_block_bits nodes
+    lambda_tuner auto_lambda_;
 #ifdef POPLAR_EXTRA_STATS
     uint64_t num_steps_ = 0;
 #endif
 
+    // Clears the keys with keeping lambda, the codes and the cache setting.
+    void reset_(uint32_t capa_bits) {
+        if (!is_ready_) {
+            is_ready_ = true;
+            init_codes_();
+        }
+        hash_trie_ = Trie{capa_bits, code_bits_ + bit_tools::ceil_log2(lambda_)};
+        label_store_ = NLM{hash_trie_.capa_bits()};
+        parents_ = compact_vector{};
+        key_bits_ = bit_vector{};
+        key_ranks_.clear();
+        reserve_parents_();
+        size_ = 0;
+#ifdef POPLAR_EXTRA_STATS
+        num_steps_ = 0;
+#endif
+        cache_.clear();
+    }
+
+    // Gives the code only to the terminator. For the fixed-length keys, every byte is its own code and the step
+    // symbol takes one more bit.
+    void init_codes_() {
+        if constexpr (key_bytes != 0) {
+            for (uint32_t c = 0; c < 256; ++c) {
+                codes_[c] = chars_[c] = static_cast<uint8_t>(c);
+            }
+            num_codes_ = 256;
+            code_bits_ = 9;
+            return;
+        }
+        codes_.fill(UINT8_MAX);
+        codes_[0] = static_cast<uint8_t>(num_codes_++);
+    }
+
+    // Rebuilds the map with one more bit for the codes.
+    void widen_codes_() {
+        rebuild_(code_bits_ + 1, lambda_, hash_trie_.capa_bits());
+    }
+
+    // Rebuilds the map with the given bits of the codes and lambda.
+    void rebuild_(uint32_t code_bits, uint64_t lambda, uint32_t capa_bits) {
+        this_type new_map;
+        new_map.lambda_ = lambda;
+        new_map.code_bits_ = code_bits;
+        new_map.reset_(capa_bits);
+        new_map.codes_ = codes_;
+        new_map.chars_ = chars_;
+        new_map.num_codes_ = num_codes_;
+        new_map.keeps_parents_ = keeps_parents_;
+        new_map.reserve_parents_();
+        new_map.cache_ = std::move(cache_);
+        new_map.cache_.clear();
+
+        std::string key;
+        enumerate([&](std::string_view key_view, auto&& value) {
+            key.assign(key_view);
+            *new_map.update(key) = std::move(value);
+        });
+        new_map.auto_lambda_ = auto_lambda_;
+        *this = std::move(new_map);
+    }
+
+    // Tunes lambda after the samples are inserted and, at the expansions, if the mean depth of the branches in
+    // the labels has changed by half or more since the last tuning.
+    void check_lambda_() {
+        lambda_tuner& tuner = auto_lambda_;
+        if (!tuner.tuned) {
+            if (size_ < tuner.num_samples) {
+                return;
+            }
+        } else {
+            // The capacity can grow without changing capa_bits if the growth is not doubling
+            if (tuner.capa_size == hash_trie_.capa_size()) {
+                return;
+            }
+            tuner.capa_size = hash_trie_.capa_size();
+
+            const double mean = tuner.current_mean();
+            const double last = tuner.tuned_mean;
+            const bool drifted = tuner.num_branches >= lambda_tuner::min_branches and
+                                 (mean * 2 >= last * 3 or last * 2 >= mean * 3);
+            if (!drifted) {
+                tuner.num_branches = tuner.sum_branches = 0;
+                return;
+            }
+        }
+
+        tuner.tuned = true;
+        tuner.capa_size = hash_trie_.capa_size();
+        tuner.tuned_mean = tuner.current_mean();
+        tuner.num_branches = tuner.sum_branches = 0;
+        ++tuner.num_tunes;
+        set_lambda_(choose_lambda_());
+    }
+
+    void set_lambda_(uint64_t lambda) {
+        if (lambda == lambda_) {
+            return;
+        }
+        if (!is_ready_ or hash_trie_.size() == 0) {
+            lambda_ = lambda;
+            reset_(is_ready_ ? hash_trie_.capa_bits() : 0);
+            return;
+        }
+        rebuild_(code_bits_, lambda, hash_trie_.capa_bits());
+    }
+
+    // Chooses lambda in [min_auto_lambda, max_auto_lambda] minimizing the memory projected from the trie. When
+    // the children of a non-step node branch at most m characters into its label, the node has m / lambda step
+    // nodes for any lambda, so the number of the step nodes is exactly derived from the max depths. Only the
+    // depths of min_auto_lambda or more matter, which are collected from the edges.
+    uint64_t choose_lambda_() const {
+        if (!is_ready_ or hash_trie_.size() == 0) {
+            return lambda_;
+        }
+
+        std::unordered_map<uint64_t, uint64_t> step_parents;
+        hash_trie_.for_each_edge([&](uint64_t parent, uint64_t symb, uint64_t child) {
+            if (symb == step_symb_()) {
+                step_parents.emplace(child, parent);
+            }
+        });
+
+        // (non-step node, depth) of the deep branches
+        std::vector<std::pair<uint64_t, uint64_t>> branches;
+        hash_trie_.for_each_edge([&](uint64_t parent, uint64_t symb, uint64_t) {
+            if (symb == step_symb_()) {
+                return;
+            }
+            uint64_t branch = symb >> code_bits_;
+            for (auto it = step_parents.find(parent); it != step_parents.end(); it = step_parents.find(parent)) {
+                branch += lambda_;
+                parent = it->second;
+            }
+            if (min_auto_lambda <= branch) {
+                branches.emplace_back(parent, branch);
+            }
+        });
+        std::sort(branches.begin(), branches.end());
+
+        constexpr uint32_t min_lambda_bits = bit_tools::ceil_log2(min_auto_lambda);
+        constexpr uint32_t num_lambdas = bit_tools::ceil_log2(max_auto_lambda) - min_lambda_bits + 1;
+
+        std::array<uint64_t, num_lambdas> num_steps = {};
+        for (uint64_t i = 0; i < branches.size(); ++i) {
+            if (i + 1 != branches.size() and branches[i].first == branches[i + 1].first) {
+                continue;  // not the max depth of the node
+            }
+            for (uint32_t j = 0; j < num_lambdas; ++j) {
+                num_steps[j] += branches[i].second >> (min_lambda_bits + j);
+            }
+        }
+
+        const uint64_t num_nodes = hash_trie_.size() - step_parents.size();
+        auto project = [&](uint64_t lambda, uint64_t steps) {
+            const uint32_t symb_bits = code_bits_ + bit_tools::ceil_log2(lambda);
+            // The FK-hash NLMs have a dummy label for each step node.
+            const uint64_t num_labels = trie_type_id == trie_type_ids::FKHASH_TRIE ? num_nodes + steps : num_nodes;
+            return projected_bytes_(num_nodes + steps, num_labels, symb_bits);
+        };
+
+        std::array<double, num_lambdas> bytes;
+        double min_bytes = std::numeric_limits<double>::max();
+        for (uint32_t i = 0; i < num_lambdas; ++i) {
+            bytes[i] = project(min_auto_lambda << i, num_steps[i]);
+            min_bytes = std::min(min_bytes, bytes[i]);
+        }
+
+        uint32_t best = 0;
+        for (uint32_t i = 0; i < num_lambdas; ++i) {
+            if (bytes[i] <= min_bytes * 1.01) {
+                best = i;
+            }
+        }
+
+        // The current lambda is kept unless the rebuild saves 3% or more.
+        if (project(lambda_, step_parents.size()) <= bytes[best] * 1.03) {
+            return lambda_;
+        }
+        return min_auto_lambda << best;
+    }
+
+    // Projects the memory for the nodes with the hash table of the fractional capacity at the maximum load
+    // factor, so that the choice does not depend on where the capacity is rounded up to a power of 2.
+    static double projected_bytes_(uint64_t num_nodes, uint64_t num_labels, uint32_t symb_bits) {
+        const double num_slots = num_nodes * 100.0 / Trie::max_factor;
+        const uint32_t capa_bits = std::max(min_capa_bits, bit_tools::ceil_log2(static_cast<uint64_t>(num_slots) + 1));
+        const double slot_rate = num_slots / (1ULL << capa_bits);
+
+        const uint64_t nlm_bytes = NLM::estimate_alloc_bytes(capa_bits, 0, 0);
+        const uint64_t slot_bytes = Trie::estimate_alloc_bytes(capa_bits, symb_bits) + nlm_bytes;
+        const uint64_t label_bytes = NLM::estimate_alloc_bytes(capa_bits, num_labels, 0) - nlm_bytes;
+        return slot_bytes * slot_rate + label_bytes;
+    }
+
+    // Searches the given key and, if found, sets the node and the offset in the key at which its label starts.
+    const_value_pointer find_(char_range key, uint64_t& found_id, uint64_t& found_offset) const {
+        const uint8_t* key_begin = key.begin;
+        auto node_id = hash_trie_.get_root();
+
+        while (!key.empty()) {
+            auto [vptr, match] = label_store_.compare(node_id, key);
+            if (vptr != nullptr) {
+                found_id = node_id;
+                found_offset = static_cast<uint64_t>(key.begin - key_begin);
+                return vptr;
+            }
+
+            key.begin += match;
+
+            while (lambda_ <= match) {
+                node_id = hash_trie_.find_child(node_id, step_symb_());
+                if (node_id == nil_id) {
+                    return nullptr;
+                }
+                match -= lambda_;
+            }
+
+            if (!is_coded_(*key.begin)) {
+                // Detecting an useless character
+                return nullptr;
+            }
+
+            node_id = hash_trie_.find_child(node_id, make_symb_(*key.begin, match));
+            if (node_id == nil_id) {
+                return nullptr;
+            }
+
+            ++key.begin;
+        }
+
+        found_id = node_id;
+        found_offset = static_cast<uint64_t>(key.begin - key_begin);
+        return label_store_.compare(node_id, key).first;
+    }
+
+    template <typename OtherTrie, typename OtherNLM>
+    static constexpr bool is_map_(const map<OtherTrie, OtherNLM>*) {
+        return true;
+    }
+    static constexpr bool is_map_(const void*) {
+        return false;
+    }
+
+    // Copies the nodes of the other map into this empty map in the depth-first order. The symbols are kept by
+    // taking lambda and the codes of the other map, and the hash table is allocated for all the nodes beforehand,
+    // so the node IDs are never changed while the nodes are added.
+    template <typename OtherMap>
+    void copy_nodes_(const OtherMap& other) {
+        lambda_ = other.lambda_;
+        code_bits_ = other.code_bits_;
+        codes_ = other.codes_;
+        chars_ = other.chars_;
+        num_codes_ = other.num_codes_;
+        is_ready_ = true;  // not to initialize the codes
+        reset_(capa_bits_for_(other.hash_trie_.size()));
+
+        if (!other.is_ready_ or other.hash_trie_.size() == 0) {
+            return;
+        }
+
+        // (parent, symb, child) of the other map sorted by the parents
+        std::vector<std::tuple<uint64_t, uint64_t, uint64_t>> edges;
+        edges.reserve(other.hash_trie_.size());
+        other.hash_trie_.for_each_edge([&](uint64_t parent, uint64_t symb, uint64_t child) {  //
+            edges.emplace_back(parent, symb, child);
+        });
+        std::sort(edges.begin(), edges.end());
+
+        struct frame {
+            uint64_t other_id;
+            uint64_t symb;
+            uint64_t parent_id;  // in this map
+        };
+        std::vector<frame> stack;
+
+        auto push_children = [&](uint64_t other_id, uint64_t node_id) {
+            auto it = std::lower_bound(edges.begin(), edges.end(), std::make_tuple(other_id, uint64_t(0), uint64_t(0)));
+            for (; it != edges.end() and std::get<0>(*it) == other_id; ++it) {
+                stack.push_back({std::get<2>(*it), std::get<1>(*it), node_id});
+            }
+        };
+
+        // Copies the label with the terminator, or nothing for the node reached by the terminator, and the value.
+        std::string label;
+        auto copy_label = [&](uint64_t other_id, uint64_t node_id, bool has_label) {
+            label.clear();
+            if (has_label) {
+                auto other_label = other.label_store_.get_label(other_id);
+                label.append(other_label.begin, other_label.end);
+                label.push_back('\0');
+            }
+            const char_range range = make_char_range_(label, 0);
+
+            auto vptr = [&]() {
+                if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+                    assert(node_id == label_store_.size());
+                    return label_store_.append(range);
+                } else {
+                    return label_store_.insert(node_id, range);
+                }
+            }();
+            auto other_vptr = other.label_store_.compare(other_id, range).first;
+            assert(other_vptr != nullptr);
+            *vptr = *other_vptr;
+            ++size_;
+        };
+
+        add_root_();
+        copy_label(other.hash_trie_.get_root(), hash_trie_.get_root(), true);
+        push_children(other.hash_trie_.get_root(), hash_trie_.get_root());
+
+        while (!stack.empty()) {
+            const frame f = stack.back();
+            stack.pop_back();
+
+            uint64_t node_id = f.parent_id;
+            [[maybe_unused]] const bool added = hash_trie_.add_child(node_id, f.symb);
+            assert(added);
+            [[maybe_unused]] const uint64_t added_id = node_id;
+            expand_if_needed_(node_id);
+            assert(node_id == added_id);
+            set_parent_(node_id, f.parent_id, f.symb);
+
+            if (f.symb == step_symb_()) {
+#ifdef POPLAR_EXTRA_STATS
+                ++num_steps_;
+#endif
+                if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+                    assert(node_id == label_store_.size());
+                    label_store_.append_dummy();
+                }
+            } else {
+                copy_label(f.other_id, node_id, chars_[f.symb & step_symb_()] != '\0');
+            }
+            push_children(f.other_id, node_id);
+        }
+    }
+
+    // Merges the nodes of the other map into this non-empty map. The key of a node of the other map continues
+    // with its label and the terminator from the position reached by its parent in this trie, which is followed
+    // as far as this trie has it. Where this trie lacks the continuation, the rest of the label is added as a new
+    // node, and the children branching further are copied below it without walking, since the new node has the
+    // same label. The positions in this trie are kept as (node, offset in its label), which stay valid since the
+    // labels are never changed.
+    template <typename OtherMap, typename MergeFn>
+    void merge_nodes_(const OtherMap& other, MergeFn& merge_fn) {
+        // (parent, symb, child) of the other map sorted by the parents
+        std::vector<std::tuple<uint64_t, uint64_t, uint64_t>> edges;
+        edges.reserve(other.hash_trie_.size());
+        other.hash_trie_.for_each_edge([&](uint64_t parent, uint64_t symb, uint64_t child) {  //
+            edges.emplace_back(parent, symb, child);
+        });
+        std::sort(edges.begin(), edges.end());
+
+        // Any character in the labels of the other map can branch in this trie, so all of them are coded
+        // beforehand, which may widen the codes and rebuild this map.
+        std::array<bool, 256> used = {};
+        auto use_label = [&](uint64_t other_id) {
+            auto other_label = other.label_store_.get_label(other_id);
+            for (const uint8_t* ptr = other_label.begin; ptr != other_label.end; ++ptr) {
+                used[*ptr] = true;
+            }
+        };
+        use_label(other.hash_trie_.get_root());
+        for (const auto& [parent, symb, child] : edges) {
+            if (symb == other.step_symb_()) {
+                continue;
+            }
+            const uint8_t c = other.chars_[symb & other.step_symb_()];
+            used[c] = true;
+            if (c != '\0') {
+                use_label(child);
+            }
+        }
+        for (uint32_t c = 0; c < 256; ++c) {
+            if (!used[c] or codes_[c] != UINT8_MAX) {
+                continue;
+            }
+            if (num_codes_ == step_symb_() and code_bits_ < 8) {
+                widen_codes_();
+            }
+            chars_[num_codes_] = static_cast<uint8_t>(c);
+            codes_[c] = static_cast<uint8_t>(num_codes_++);
+            POPLAR_THROW_IF(UINT8_MAX == num_codes_, "");
+        }
+
+        // The children of a non-step node of the other map with the depths in its label through the step nodes
+        struct branch {
+            uint64_t match;
+            uint8_t c;
+            uint64_t other_id;
+        };
+        std::vector<branch> branches;
+        std::vector<std::pair<uint64_t, uint64_t>> step_stack;
+        auto collect_branches = [&](uint64_t other_id) {
+            branches.clear();
+            step_stack.emplace_back(other_id, 0);
+            while (!step_stack.empty()) {
+                const auto [id, offset] = step_stack.back();
+                step_stack.pop_back();
+                auto it = std::lower_bound(edges.begin(), edges.end(), std::make_tuple(id, uint64_t(0), uint64_t(0)));
+                for (; it != edges.end() and std::get<0>(*it) == id; ++it) {
+                    const uint64_t symb = std::get<1>(*it);
+                    if (symb == other.step_symb_()) {
+                        step_stack.emplace_back(std::get<2>(*it), offset + other.lambda_);
+                    } else {
+                        const uint8_t c = other.chars_[symb & other.step_symb_()];
+                        branches.push_back({offset + (symb >> other.code_bits_), c, std::get<2>(*it)});
+                    }
+                }
+            }
+            std::sort(branches.begin(), branches.end(),
+                      [](const branch& a, const branch& b) { return a.match < b.match; });
+        };
+
+        // A walking frame has the position of this trie where the label of the other node starts, and a copying
+        // frame has the position where the other node is added with the character.
+        struct frame {
+            uint64_t other_id;
+            bool copies;
+            uint8_t c;
+            uint64_t node_id;
+            uint64_t offset;
+        };
+        std::vector<frame> stack;
+        uint64_t cur_id = hash_trie_.get_root(), cur_offset = 0;
+
+        auto remap = [&](const auto& node_map) {
+            cur_id = node_map[cur_id];
+            for (frame& f : stack) {
+                f.node_id = node_map[f.node_id];
+            }
+        };
+
+        // Finds the child of the given node branching at offset with c, or nil_id.
+        auto find_child = [&](uint64_t node_id, uint64_t offset, uint8_t c) -> uint64_t {
+            for (; lambda_ <= offset; offset -= lambda_) {
+                node_id = hash_trie_.find_child(node_id, step_symb_());
+                if (node_id == nil_id) {
+                    return nil_id;
+                }
+            }
+            return hash_trie_.find_child(node_id, make_symb_(c, offset));
+        };
+        // Adds the child of the given node branching at offset with c, which must be new, as update() does.
+        auto add_child = [&](uint64_t node_id, uint64_t offset, uint8_t c, char_range label) {
+            for (; lambda_ <= offset; offset -= lambda_) {
+                const uint64_t parent_id = node_id;
+                if (hash_trie_.add_child(node_id, step_symb_())) {
+                    expand_if_needed_(node_id, remap);
+                    set_parent_(node_id, parent_id, step_symb_());
+#ifdef POPLAR_EXTRA_STATS
+                    ++num_steps_;
+#endif
+                    if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+                        assert(node_id == label_store_.size());
+                        label_store_.append_dummy();
+                    }
+                }
+            }
+            const uint64_t parent_id = node_id;
+            const uint64_t symb = make_symb_(c, offset);
+            [[maybe_unused]] const bool added = hash_trie_.add_child(node_id, symb);
+            assert(added);
+            expand_if_needed_(node_id, remap);
+            set_parent_(node_id, parent_id, symb);
+            ++size_;
+
+            if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+                assert(node_id == label_store_.size());
+                return std::make_pair(node_id, label_store_.append(label));
+            } else {
+                return std::make_pair(node_id, label_store_.insert(node_id, label));
+            }
+        };
+
+        std::string label, this_label;
+        // Sets label to the label of the other node with the terminator, or empty if reached by the terminator.
+        auto load_label = [&](uint64_t other_id, uint8_t c) {
+            label.clear();
+            if (other_id == other.hash_trie_.get_root() or c != '\0') {
+                auto other_label = other.label_store_.get_label(other_id);
+                label.append(other_label.begin, other_label.end);
+                label.push_back('\0');
+            }
+        };
+        // Gets the value of the other node, whose label with the terminator must be given.
+        auto other_value = [&](uint64_t other_id, char_range other_label) {
+            auto other_vptr = other.label_store_.compare(other_id, other_label).first;
+            assert(other_vptr != nullptr);
+            return typename OtherMap::value_type(*other_vptr);
+        };
+        auto set_value = [&](value_pointer vptr, bool is_new, const auto& value) {
+            if (is_new) {
+                *vptr = value;
+            } else {
+                value_type merged = *vptr;
+                merge_fn(merged, value);
+                *vptr = std::move(merged);
+            }
+        };
+
+        // Copies the other node below the node of this trie without walking.
+        auto copy_node = [&](const frame& f) {
+            load_label(f.other_id, f.c);
+            auto [node_id, vptr] = add_child(f.node_id, f.offset, f.c, make_char_range_(label, 0));
+            set_value(vptr, true, other_value(f.other_id, make_char_range_(label, 0)));
+            if (f.c != '\0') {
+                collect_branches(f.other_id);
+                for (const branch& b : branches) {
+                    stack.push_back({b.other_id, true, b.c, node_id, b.match});
+                }
+            }
+        };
+
+        // Merges the key ending at the current position, i.e., of the node or its child reached by the terminator.
+        auto merge_end = [&](const auto& value) {
+            auto this_range = label_store_.get_label(cur_id);
+            if (cur_offset == this_range.length()) {
+                this_label.assign(this_range.begin, this_range.end);
+                this_label.push_back('\0');
+                auto vptr = label_store_.compare(cur_id, make_char_range_(this_label, 0)).first;
+                assert(vptr != nullptr);
+                set_value(to_mutable_(vptr), false, value);
+            } else if (const uint64_t child_id = find_child(cur_id, cur_offset, '\0'); child_id != nil_id) {
+                auto vptr = label_store_.compare(child_id, char_range{}).first;
+                assert(vptr != nullptr);
+                set_value(to_mutable_(vptr), false, value);
+            } else {
+                set_value(add_child(cur_id, cur_offset, '\0', char_range{}).second, true, value);
+            }
+        };
+
+        stack.push_back({other.hash_trie_.get_root(), false, 0, hash_trie_.get_root(), 0});
+
+        while (!stack.empty()) {
+            const frame f = stack.back();
+            stack.pop_back();
+
+            if (f.copies) {
+                copy_node(f);
+                continue;
+            }
+
+            load_label(f.other_id, f.c);
+            collect_branches(f.other_id);
+            cur_id = f.node_id;
+            cur_offset = f.offset;
+
+            auto this_range = label_store_.get_label(cur_id);
+            uint64_t i = 0;  // of branches
+
+            for (uint64_t pos = 0;; ++pos) {
+                // The children of the other node branching here continue from the current position.
+                for (; i < branches.size() and branches[i].match == pos; ++i) {
+                    const branch& b = branches[i];
+                    if (b.c == '\0') {
+                        // The key ends here, so the other node has no label.
+                        merge_end(other_value(b.other_id, char_range{}));
+                        this_range = label_store_.get_label(cur_id);
+                    } else if (cur_offset < this_range.length() and this_range.begin[cur_offset] == b.c) {
+                        stack.push_back({b.other_id, false, b.c, cur_id, cur_offset + 1});
+                    } else if (const uint64_t child_id = find_child(cur_id, cur_offset, b.c); child_id != nil_id) {
+                        stack.push_back({b.other_id, false, b.c, child_id, 0});
+                    } else {
+                        stack.push_back({b.other_id, true, b.c, cur_id, cur_offset});
+                    }
+                }
+
+                const uint8_t c = static_cast<uint8_t>(label[pos]);
+                if (c == '\0') {
+                    merge_end(other_value(f.other_id, make_char_range_(label, 0)));
+                    break;
+                }
+                if (cur_offset < this_range.length() and this_range.begin[cur_offset] == c) {
+                    ++cur_offset;
+                    continue;
+                }
+                if (const uint64_t child_id = find_child(cur_id, cur_offset, c); child_id != nil_id) {
+                    cur_id = child_id;
+                    cur_offset = 0;
+                    this_range = label_store_.get_label(cur_id);
+                    continue;
+                }
+
+                // This trie lacks the rest of the label, which is added with the children branching further.
+                const char_range rest = make_char_range_(label, pos + 1);
+                auto [node_id, vptr] = add_child(cur_id, cur_offset, c, rest);
+                set_value(vptr, true, other_value(f.other_id, make_char_range_(label, 0)));
+                for (; i < branches.size(); ++i) {
+                    const branch& b = branches[i];
+                    stack.push_back({b.other_id, true, b.c, node_id, b.match - pos - 1});
+                }
+                break;
+            }
+        }
+    }
+
+    // Calls fn(key, vptr) for every registered key.
+    template <typename Fn>
+    void enumerate_(Fn fn) const {
+        if (!is_ready_ or hash_trie_.size() == 0) {
+            return;
+        }
+
+        // (parent, symb, child) sorted by the parents
+        std::vector<std::tuple<uint64_t, uint64_t, uint64_t>> edges;
+        edges.reserve(hash_trie_.size());
+        hash_trie_.for_each_edge([&](uint64_t parent, uint64_t symb, uint64_t child) {  //
+            edges.emplace_back(parent, symb, child);
+        });
+        std::sort(edges.begin(), edges.end());
+
+        // The key of a node is the key of its nearest non-step ancestor, the first (offset + match) characters of
+        // the label of the ancestor, and the edge character. So the stack keeps the ancestor's information.
+        struct frame {
+            uint64_t node_id;
+            uint64_t symb;
+            uint64_t prefix_length;  // of the non-step ancestor
+            char_range label;  // of the non-step ancestor
+            uint64_t offset;  // consumed by the step nodes
+        };
+        std::vector<frame> stack;
+        std::string key;
+
+        auto push_children = [&](uint64_t node_id, uint64_t prefix_length, char_range label, uint64_t offset) {
+            auto it = std::lower_bound(edges.begin(), edges.end(), std::make_tuple(node_id, uint64_t(0), uint64_t(0)));
+            for (; it != edges.end() and std::get<0>(*it) == node_id; ++it) {
+                stack.push_back({std::get<2>(*it), std::get<1>(*it), prefix_length, label, offset});
+            }
+        };
+
+        // Reports the node whose key is given in key[0..prefix_length) except the label
+        auto visit = [&](uint64_t node_id, uint64_t prefix_length) {
+            char_range label;
+            if constexpr (key_bytes != 0) {
+                label = label_store_.get_label(node_id, key_bytes - prefix_length);
+            } else {
+                label = label_store_.get_label(node_id);
+            }
+            key.resize(prefix_length);
+            key.append(label.begin, label.end);
+            if constexpr (key_bytes == 0) {
+                key.push_back('\0');
+            }
+
+            auto vptr = label_store_.compare(node_id, make_char_range_(key, prefix_length)).first;
+            assert(vptr != nullptr);
+            fn(std::string_view{key.data(), key.size() - (key_bytes == 0 ? 1 : 0)}, vptr);
+
+            push_children(node_id, prefix_length, label, 0);
+        };
+
+        visit(hash_trie_.get_root(), 0);
+
+        while (!stack.empty()) {
+            const frame f = stack.back();
+            stack.pop_back();
+
+            if (f.symb == step_symb_()) {
+                push_children(f.node_id, f.prefix_length, f.label, f.offset + lambda_);
+                continue;
+            }
+
+            const uint8_t c = chars_[f.symb & step_symb_()];
+            key.resize(f.prefix_length);
+            key.append(f.label.begin, f.label.begin + (f.offset + (f.symb >> code_bits_)));
+            key.push_back(static_cast<char>(c));
+
+            if (key_bytes == 0 and c == '\0') {
+                // The key ends at the node, which has only the value.
+                auto vptr = label_store_.compare(f.node_id, char_range{}).first;
+                assert(vptr != nullptr);
+                fn(std::string_view{key.data(), key.size() - 1}, vptr);
+                continue;
+            }
+
+            visit(f.node_id, key.size());
+        }
+    }
+
+    // The values are owned by the non-const map.
+    static value_pointer to_mutable_(const_value_pointer vptr) {
+        if constexpr (std::is_pointer_v<value_pointer>) {
+            return const_cast<value_pointer>(vptr);
+        } else {
+            return value_pointer{vptr};
+        }
+    }
+
+    static char_range make_char_range_(const std::string& str, uint64_t pos) {
+        auto ptr = reinterpret_cast<const uint8_t*>(str.data());
+        return {ptr + pos, ptr + str.size()};
+    }
+
+    // The fixed-length keys are given without the terminator.
+    static char_range make_key_range_(const std::string& key) {
+        if constexpr (key_bytes != 0) {
+            return make_char_range_(key, 0);
+        } else {
+            return make_char_range(key);
+        }
+    }
+
+    static void check_key_(char_range key) {
+        if constexpr (key_bytes != 0) {
+            POPLAR_THROW_IF(key.length() != key_bytes, "key must be of key_bytes bytes.");
+        } else {
+            POPLAR_THROW_IF(key.empty(), "key must be a non-empty string.");
+            POPLAR_THROW_IF(*(key.end - 1) != '\0', "The last character of key must be the null terminator.");
+        }
+    }
+
+    // Every byte is coded for the fixed-length keys, whose codes_ cannot tell the byte 0xFF from no code.
+    bool is_coded_(uint8_t c) const {
+        return key_bytes != 0 or codes_[c] != UINT8_MAX;
+    }
+
+    // The largest code with match = 0 is used for the step nodes.
+    uint64_t step_symb_() const {
+        return (1ULL << code_bits_) - 1;
+    }
+
     uint64_t make_symb_(uint8_t c, uint64_t match) const {
-        assert(codes_[c] != UINT8_MAX);
-        return static_cast<uint64_t>(codes_[c]) | (match << 8);
+        assert(is_coded_(c));
+        return static_cast<uint64_t>(codes_[c]) | (match << code_bits_);
+    }
+
+    // A label keeps about half of the key on average because the other half is consumed by the trie,
+    // and step nodes are rare unless the labels are long compared with lambda.
+    static uint64_t estimate_label_length_(uint64_t avg_key_len) {
+        return avg_key_len / 2;
+    }
+    static uint32_t estimate_capa_bits_(uint64_t num_keys, uint64_t avg_key_len, uint64_t lambda) {
+        uint64_t num_nodes = num_keys + num_keys * estimate_label_length_(avg_key_len) / (lambda * lambda);
+        return bit_tools::ceil_log2(num_nodes * 100 / Trie::max_factor + 1);
+    }
+
+    // Gets the smallest capa_bits of the hash table storing the nodes within the maximum load factor.
+    static uint32_t capa_bits_for_(uint64_t num_nodes) {
+        uint32_t capa_bits = min_capa_bits;
+        while (static_cast<uint64_t>((1ULL << capa_bits) * Trie::max_factor / 100.0) <= num_nodes) {
+            ++capa_bits;
+        }
+        return capa_bits;
+    }
+
+    void resize_(uint32_t capa_bits) {
+        if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+            hash_trie_.resize(capa_bits);
+            label_store_.reserve(hash_trie_.capa_size());
+            reserve_parents_();
+        }
+        if constexpr (trie_type_id == trie_type_ids::BONSAI_TRIE) {
+            auto node_map = hash_trie_.resize(capa_bits);
+            label_store_.resize(node_map, hash_trie_.capa_bits());
+            cache_.clear();
+        }
     }
 
     void expand_if_needed_(uint64_t& node_id) {
+        expand_if_needed_(node_id, [](const auto&) {});
+    }
+    // remap(node_map) is called to update the other node IDs held by the caller when the bonsai tries expand.
+    template <typename Fn>
+    void expand_if_needed_(uint64_t& node_id, Fn remap) {
         if constexpr (trie_type_id == trie_type_ids::BONSAI_TRIE) {
             if (!hash_trie_.needs_to_expand()) {
                 return;
@@ -268,6 +1405,98 @@ class map {
             auto node_map = hash_trie_.expand();
             node_id = node_map[node_id];
             label_store_.expand(node_map);
+            cache_.clear();
+            remap(node_map);
+        }
+        if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+            // The trie expands by itself, so the NLM follows it and is relocated only at the same time.
+            label_store_.reserve(hash_trie_.capa_size());
+            reserve_parents_();
+        }
+    }
+
+    // The followings keep the parents for the FK-hash tries.
+    void reserve_parents_() {
+        if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+            if (!keeps_parents_) {
+                return;
+            }
+            const uint32_t width = hash_trie_.capa_bits() + hash_trie_.symb_bits();
+            if (parents_.size() != hash_trie_.capa_size() or parents_.width() != width) {
+                compact_vector new_parents(hash_trie_.capa_size(), width);
+                for (uint64_t i = 0; i < std::min(parents_.size(), hash_trie_.size()); ++i) {
+                    new_parents.set(i, parents_[i]);
+                }
+                parents_ = std::move(new_parents);
+            }
+        }
+    }
+    void set_parent_(uint64_t node_id, uint64_t parent_id, uint64_t symb) {
+        if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+            if (keeps_parents_) {
+                parents_.set(node_id, (parent_id << hash_trie_.symb_bits()) | symb);
+                assert(node_id == key_bits_.size());
+                append_key_bit_(symb != step_symb_());
+            }
+        }
+    }
+    void add_root_() {
+        hash_trie_.add_root();
+        if constexpr (trie_type_id == trie_type_ids::FKHASH_TRIE) {
+            if (keeps_parents_) {
+                assert(hash_trie_.get_root() == key_bits_.size());
+                append_key_bit_(true);
+            }
+        }
+    }
+    // Gets the parent and the symbol of the edge to the node, where the parent is nil_id for the root.
+    std::pair<uint64_t, uint64_t> get_parent_and_symb_(uint64_t node_id) const {
+        if (node_id == hash_trie_.get_root()) {
+            return {nil_id, 0};
+        }
+        const uint64_t x = parents_[node_id];
+        return {x >> hash_trie_.symb_bits(), x & (hash_trie_.symb_size() - 1)};
+    }
+
+    // The followings map the nodes to the dense key IDs for the FK-hash tries, whose node IDs are given in the
+    // insertion order. The key bits are appended as the nodes are added, and the number of the keys before
+    // every block of key_block_bits nodes is kept.
+    static constexpr uint64_t key_block_bits = 512;
+
+    void append_key_bit_(bool is_key) {
+        const uint64_t pos = key_bits_.size();
+        if (pos % key_block_bits == 0) {
+            key_ranks_.push_back(pos == 0 ? 0 : key_ranks_.back() + count_keys_(pos - key_block_bits, pos));
+        }
+        key_bits_.append_bit(is_key);
+    }
+    // Gets the number of the keys in the nodes of [begin, end), which must be in a block.
+    uint64_t count_keys_(uint64_t begin, uint64_t end) const {
+        uint64_t num = 0;
+        for (; begin + 64 <= end; begin += 64) {
+            num += bit_tools::popcnt(key_bits_.get_bits(begin, 64));
+        }
+        return num + bit_tools::popcnt(key_bits_.get_bits(begin, static_cast<uint32_t>(end - begin)));
+    }
+    // Gets the key ID of the node storing a key.
+    uint64_t key_rank_(uint64_t node_id) const {
+        const uint64_t block_id = node_id / key_block_bits;
+        return key_ranks_[block_id] + count_keys_(block_id * key_block_bits, node_id);
+    }
+    // Gets the node storing the key of the given ID.
+    uint64_t key_select_(uint64_t id) const {
+        const auto it = std::upper_bound(key_ranks_.begin(), key_ranks_.end(), id);
+        const uint64_t block_id = static_cast<uint64_t>(it - key_ranks_.begin()) - 1;
+
+        uint64_t rank = key_ranks_[block_id];
+        for (uint64_t pos = block_id * key_block_bits;; pos += 64) {
+            const uint32_t len = static_cast<uint32_t>(std::min<uint64_t>(64, key_bits_.size() - pos));
+            const uint64_t bits = key_bits_.get_bits(pos, len);
+            const uint64_t num = bit_tools::popcnt(bits);
+            if (id < rank + num) {
+                return pos + bit_tools::select(bits, id - rank + 1);
+            }
+            rank += num;
         }
     }
 };
@@ -0,0 +1,240 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_PARTITIONED_MAP_HPP
+#define POPLAR_TRIE_PARTITIONED_MAP_HPP
+
+#include <exception>
+#include <iostream>
+#include <thread>
+
+#include "exception.hpp"
+#include "hash.hpp"
+
+namespace poplar {
+
+// This class implements an associative array split into independent maps by the hash values of the keys, so
+// that the parts can be built by different threads. Each key belongs to exactly one part, so find() and
+// update() behave the same as a single map at the cost of hashing the key once.
+template <typename Map>
+class partitioned_map {
+  public:
+    using this_type = partitioned_map<Map>;
+    using map_type = Map;
+    using value_type = typename Map::value_type;
+    using value_pointer = typename Map::value_pointer;
+    using const_value_pointer = typename Map::const_value_pointer;
+
+  public:
+    // Generic constructor.
+    partitioned_map() : partitioned_map(1) {}
+
+    // Class constructor. Each part initially allocates the hash table of length 2**capa_bits.
+    explicit partitioned_map(uint64_t num_parts, uint32_t capa_bits = 0, uint64_t lambda = 32) {
+        POPLAR_THROW_IF(num_parts == 0, "num_parts must not be zero.");
+        parts_.reserve(num_parts);
+        for (uint64_t i = 0; i < num_parts; ++i) {
+            parts_.emplace_back(capa_bits, lambda);
+        }
+    }
+
+    // Generic destructor.
+    ~partitioned_map() = default;
+
+    // Builds the map from the keys and the values of the same indices with num_threads threads, where each
+    // thread builds num_parts / num_threads parts. num_parts is 4 * num_threads if zero, which balances the
+    // threads even when the keys are skewed to some parts.
+    static this_type parallel_build(const std::vector<std::string>& keys, const std::vector<value_type>& values,
+                                    uint32_t num_threads, uint64_t num_parts = 0, uint64_t lambda = 32) {
+        POPLAR_THROW_IF(keys.size() != values.size(), "keys and values must be of the same size.");
+        return parallel_build_(keys, &values, num_threads, num_parts, lambda);
+    }
+    // Same as above but the values are left as default.
+    static this_type parallel_build(const std::vector<std::string>& keys, uint32_t num_threads,
+                                    uint64_t num_parts = 0, uint64_t lambda = 32) {
+        return parallel_build_(keys, nullptr, num_threads, num_parts, lambda);
+    }
+
+    // Searches the given key and returns the value pointer if registered;
+    // otherwise returns nullptr.
+    const_value_pointer find(const std::string& key) const {
+        return find(make_char_range(key));
+    }
+    const_value_pointer find(char_range key) const {
+        POPLAR_THROW_IF(key.empty(), "key must be a non-empty string.");
+        return parts_[part_id_(key.begin, key.length() - 1)].find(key);
+    }
+
+    // Inserts the given key and returns the value pointer.
+    value_pointer update(const std::string& key) {
+        return update(make_char_range(key));
+    }
+    value_pointer update(char_range key) {
+        POPLAR_THROW_IF(key.empty(), "key must be a non-empty string.");
+        return parts_[part_id_(key.begin, key.length() - 1)].update(key);
+    }
+
+    // Calls fn(key, value) for every registered key in the order of the parts.
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        for (const auto& part : parts_) {
+            part.enumerate(fn);
+        }
+    }
+    template <typename Fn>
+    void enumerate(Fn fn) {
+        for (auto& part : parts_) {
+            part.enumerate(fn);
+        }
+    }
+
+    // Gets the number of registered keys.
+    uint64_t size() const {
+        uint64_t size = 0;
+        for (const auto& part : parts_) {
+            size += part.size();
+        }
+        return size;
+    }
+    uint64_t num_parts() const {
+        return parts_.size();
+    }
+    const map_type& get_part(uint64_t i) const {
+        return parts_[i];
+    }
+    uint64_t alloc_bytes() const {
+        uint64_t bytes = parts_.capacity() * sizeof(map_type);
+        for (const auto& part : parts_) {
+            bytes += part.alloc_bytes();
+        }
+        return bytes;
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "partitioned_map");
+        show_stat(os, indent, "num_parts", num_parts());
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+        show_member(os, indent, "parts_[0]");
+        parts_[0].show_stats(os, n + 1);
+    }
+
+    partitioned_map(const partitioned_map&) = delete;
+    partitioned_map& operator=(const partitioned_map&) = delete;
+
+    partitioned_map(partitioned_map&&) noexcept = default;
+    partitioned_map& operator=(partitioned_map&&) noexcept = default;
+
+  private:
+    std::vector<map_type> parts_;
+
+    uint64_t part_id_(const uint8_t* key, uint64_t length) const {
+        return hash::fast_range(hash::hash_bytes(key, length), parts_.size());
+    }
+
+    static this_type parallel_build_(const std::vector<std::string>& keys, const std::vector<value_type>* values,
+                                     uint32_t num_threads, uint64_t num_parts, uint64_t lambda) {
+        POPLAR_THROW_IF(num_threads == 0, "num_threads must not be zero.");
+        if (num_parts == 0) {
+            num_parts = uint64_t(num_threads) * 4;
+        }
+
+        this_type map(num_parts, 0, lambda);
+
+        // Runs fn(t) for each thread t and rethrows the first exception.
+        auto run = [&](auto fn) {
+            std::vector<std::exception_ptr> errors(num_threads);
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < num_threads; ++t) {
+                threads.emplace_back([&, t] {
+                    try {
+                        fn(t);
+                    } catch (...) {
+                        errors[t] = std::current_exception();
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            for (const auto& error : errors) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        };
+
+        // The key IDs are grouped by the parts through counting sort.
+        std::vector<uint32_t> part_ids(keys.size());
+        run([&](uint32_t t) {
+            for (uint64_t i = t; i < keys.size(); i += num_threads) {
+                POPLAR_THROW_IF(keys[i].find('\0') != std::string::npos, "key must not contain '\\0'.");
+                part_ids[i] = static_cast<uint32_t>(
+                    map.part_id_(reinterpret_cast<const uint8_t*>(keys[i].data()), keys[i].size()));
+            }
+        });
+
+        std::vector<uint64_t> begins(num_parts + 1);
+        for (uint32_t part_id : part_ids) {
+            ++begins[part_id + 1];
+        }
+        for (uint64_t i = 0; i < num_parts; ++i) {
+            begins[i + 1] += begins[i];
+        }
+        std::vector<uint64_t> key_ids(keys.size());
+        {
+            std::vector<uint64_t> ends(begins.begin(), begins.end() - 1);
+            for (uint64_t i = 0; i < keys.size(); ++i) {
+                key_ids[ends[part_ids[i]]++] = i;
+            }
+        }
+        part_ids = {};
+
+        run([&](uint32_t t) {
+            for (uint64_t part_id = t; part_id < num_parts; part_id += num_threads) {
+                map_type& part = map.parts_[part_id];
+                const uint64_t num_keys = begins[part_id + 1] - begins[part_id];
+
+                uint64_t sum_length = 0;
+                for (uint64_t i = begins[part_id]; i < begins[part_id + 1]; ++i) {
+                    sum_length += keys[key_ids[i]].size();
+                }
+                part.reserve(num_keys, num_keys == 0 ? 0 : sum_length / num_keys);
+
+                for (uint64_t i = begins[part_id]; i < begins[part_id + 1]; ++i) {
+                    auto vptr = part.update(keys[key_ids[i]]);
+                    if (values != nullptr) {
+                        *vptr = (*values)[key_ids[i]];
+                    }
+                }
+            }
+        });
+
+        return map;
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_PARTITIONED_MAP_HPP
@@ -28,6 +28,7 @@
 #include <vector>
 
 #include "basics.hpp"
+#include "bit_tools.hpp"
 #include "compact_vector.hpp"
 
 namespace poplar {
@@ -36,8 +37,13 @@ template <typename Value>
 class plain_bonsai_nlm {
   public:
     using value_type = Value;
+    using value_pointer = value_type*;
+    using const_value_pointer = const value_type*;
 
     static constexpr auto trie_type_id = trie_type_ids::BONSAI_TRIE;
+    static constexpr bool stable_values = false;  // the values move with the labels
+    static constexpr uint64_t value_size = value_size_v<Value>;
+    static constexpr uint32_t key_bytes = 0;  // the keys are null-terminated
 
   public:
     plain_bonsai_nlm() = default;
@@ -65,17 +71,27 @@ class plain_bonsai_nlm {
         return {reinterpret_cast<const value_type*>(ptr + key.length()), key.length()};
     }
 
+    // Gets the label at pos without the terminator. pos must not be a node reached by the terminator
+    // because such a node has no label but only the value.
+    char_range get_label(uint64_t pos) const {
+        assert(pos < ptrs_.size());
+        assert(ptrs_[pos]);
+
+        const uint8_t* ptr = ptrs_[pos].get();
+        return {ptr, ptr + std::strlen(reinterpret_cast<const char*>(ptr))};
+    }
+
     value_type* insert(uint64_t pos, const char_range& key) {
         assert(!ptrs_[pos]);
 
         ++size_;
 
         uint64_t length = key.length();
-        ptrs_[pos] = std::make_unique<uint8_t[]>(length + sizeof(value_type));
+        ptrs_[pos] = std::make_unique<uint8_t[]>(length + value_size);
         auto ptr = ptrs_[pos].get();
         copy_bytes(ptr, key.begin, length);
 
-        label_bytes_ += length + sizeof(value_type);
+        label_bytes_ += length + value_size;
 
 #ifdef POPLAR_EXTRA_STATS
         max_length_ = std::max(max_length_, length);
@@ -83,14 +99,22 @@ class plain_bonsai_nlm {
 #endif
 
         auto ret = reinterpret_cast<value_type*>(ptr + length);
-        *ret = static_cast<value_type>(0);
+        if constexpr (value_size != 0) {
+            *ret = static_cast<value_type>(0);
+        }
 
         return ret;
     }
 
     template <typename T>
     void expand(const T& pos_map) {
-        std::vector<std::unique_ptr<uint8_t[]>> new_ptrs(ptrs_.size() * 2);
+        resize(pos_map, bit_tools::ceil_log2(ptrs_.size() * 2));
+    }
+
+    // Moves the labels to the positions given by pos_map in a table of 2**capa_bits slots.
+    template <typename T>
+    void resize(const T& pos_map, uint32_t capa_bits) {
+        std::vector<std::unique_ptr<uint8_t[]>> new_ptrs(1ULL << capa_bits);
         for (uint64_t i = 0; i < pos_map.size(); ++i) {
             if (pos_map[i] != UINT64_MAX) {
                 new_ptrs[pos_map[i]] = std::move(ptrs_[i]);
@@ -99,6 +123,10 @@ class plain_bonsai_nlm {
         ptrs_ = std::move(new_ptrs);
     }
 
+    void shrink_to_fit() {
+        ptrs_.shrink_to_fit();
+    }
+
     uint64_t size() const {
         return size_;
     }
@@ -112,6 +140,15 @@ class plain_bonsai_nlm {
         return bytes;
     }
 
+    // Estimates alloc_bytes() after storing num_labels labels of label_bytes bytes in total,
+    // excluding the terminators.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint64_t num_labels, uint64_t label_bytes) {
+        uint64_t bytes = 0;
+        bytes += (1ULL << capa_bits) * sizeof(std::unique_ptr<uint8_t[]>);
+        bytes += label_bytes + num_labels * (1 + value_size);
+        return bytes;
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "plain_bonsai_nlm");
@@ -27,6 +27,7 @@
 #include "bit_tools.hpp"
 #include "bit_vector.hpp"
 #include "compact_vector.hpp"
+#include "exception.hpp"
 #include "hash.hpp"
 
 namespace poplar {
@@ -39,6 +40,7 @@ class plain_bonsai_trie {
   public:
     static constexpr uint64_t nil_id = UINT64_MAX;
     static constexpr uint32_t min_capa_bits = 16;
+    static constexpr uint32_t max_factor = MaxFactor;
 
     static constexpr auto trie_type_id = trie_type_ids::BONSAI_TRIE;
 
@@ -143,6 +145,17 @@ class plain_bonsai_trie {
         return std::make_pair(key >> symb_size_.bits(), key & symb_size_.mask());
     };
 
+    // Calls fn(parent, symb, child) for every edge in the slot order.
+    template <typename Fn>
+    void for_each_edge(Fn fn) const {
+        for (uint64_t i = 0; i < capa_size_.size(); ++i) {
+            auto [parent, symb] = get_parent_and_symb(i);
+            if (parent != nil_id) {
+                fn(parent, symb, i);
+            }
+        }
+    }
+
     class node_map {
       public:
         node_map() = default;
@@ -176,7 +189,13 @@ class plain_bonsai_trie {
     }
 
     node_map expand() {
-        plain_bonsai_trie new_ht{capa_bits() + 1, symb_size_.bits()};
+        return resize(capa_bits() + 1);
+    }
+
+    // Rebuilds the trie with 2**capa_bits slots and returns the mapping from old to new node IDs.
+    node_map resize(uint32_t capa_bits) {
+        plain_bonsai_trie new_ht{capa_bits, symb_size_.bits()};
+        POPLAR_THROW_IF(new_ht.max_size() <= size(), "capa_bits is too small to store the nodes.");
         new_ht.add_root();
 
 #ifdef POPLAR_EXTRA_STATS
@@ -186,6 +205,15 @@ class plain_bonsai_trie {
         bit_vector done_flags(capa_size());
         done_flags.set(get_root());
 
+        if (table_.width() < new_ht.capa_bits()) {
+            // The slots are reused for the mapping, so widen them to hold the new node IDs.
+            compact_vector new_table(table_.size(), new_ht.capa_bits());
+            for (uint64_t i = 0; i < table_.size(); ++i) {
+                new_table.set(i, table_[i]);
+            }
+            table_ = std::move(new_table);
+        }
+
         table_.set(get_root(), new_ht.get_root());
 
         std::vector<std::pair<uint64_t, uint64_t>> path;
@@ -251,6 +279,12 @@ class plain_bonsai_trie {
         return table_.alloc_bytes();
     }
 
+    // Estimates alloc_bytes() just after construction with the given parameters.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint32_t symb_bits) {
+        capa_bits = std::max(min_capa_bits, capa_bits);
+        return bit_tools::words_for((1ULL << capa_bits) * (capa_bits + symb_bits)) * sizeof(uint64_t);
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "plain_bonsai_trie");
@@ -35,8 +35,13 @@ template <typename Value>
 class plain_fkhash_nlm {
   public:
     using value_type = Value;
+    using value_pointer = value_type*;
+    using const_value_pointer = const value_type*;
 
     static constexpr auto trie_type_id = trie_type_ids::FKHASH_TRIE;
+    static constexpr bool stable_values = false;  // the values move with the labels
+    static constexpr uint64_t value_size = value_size_v<Value>;
+    static constexpr uint32_t key_bytes = 0;  // the keys are null-terminated
 
   public:
     plain_fkhash_nlm() = default;
@@ -66,10 +71,20 @@ class plain_fkhash_nlm {
         return {reinterpret_cast<const value_type*>(ptr + key.length()), key.length()};
     }
 
+    // Gets the label at pos without the terminator. pos must not be a node reached by the terminator
+    // because such a node has no label but only the value.
+    char_range get_label(uint64_t pos) const {
+        assert(pos < ptrs_.size());
+        assert(ptrs_[pos]);
+
+        const uint8_t* ptr = ptrs_[pos].get();
+        return {ptr, ptr + std::strlen(reinterpret_cast<const char*>(ptr))};
+    }
+
     value_type* append(const char_range& key) {
         uint64_t length = key.length();
-        ptrs_.emplace_back(std::make_unique<uint8_t[]>(length + sizeof(value_type)));
-        label_bytes_ += length + sizeof(value_type);
+        ptrs_.emplace_back(std::make_unique<uint8_t[]>(length + value_size));
+        label_bytes_ += length + value_size;
 
         auto ptr = ptrs_.back().get();
         copy_bytes(ptr, key.begin, length);
@@ -80,7 +95,9 @@ class plain_fkhash_nlm {
 #endif
 
         auto ret = reinterpret_cast<value_type*>(ptr + length);
-        *ret = static_cast<value_type>(0);
+        if constexpr (value_size != 0) {
+            *ret = static_cast<value_type>(0);
+        }
 
         return ret;
     }
@@ -89,6 +106,15 @@ class plain_fkhash_nlm {
         ptrs_.emplace_back(nullptr);
     }
 
+    // Reserves the space for num_nodes nodes.
+    void reserve(uint64_t num_nodes) {
+        ptrs_.reserve(num_nodes);
+    }
+
+    void shrink_to_fit() {
+        ptrs_.shrink_to_fit();
+    }
+
     uint64_t size() const {
         return ptrs_.size();
     }
@@ -99,6 +125,15 @@ class plain_fkhash_nlm {
         return bytes;
     }
 
+    // Estimates alloc_bytes() after storing num_labels labels of label_bytes bytes in total,
+    // excluding the terminators.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint64_t num_labels, uint64_t label_bytes) {
+        uint64_t bytes = 0;
+        bytes += (1ULL << capa_bits) * sizeof(std::unique_ptr<uint8_t[]>);
+        bytes += label_bytes + num_labels * (1 + value_size);
+        return bytes;
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "plain_fkhash_nlm");
@@ -29,33 +29,34 @@
 #include "bit_tools.hpp"
 #include "bit_vector.hpp"
 #include "compact_vector.hpp"
+#include "exception.hpp"
 #include "hash.hpp"
 
 namespace poplar {
 
 // The node IDs are arranged incrementally
-template <uint32_t MaxFactor = 90, typename Hasher = hash::vigna_hasher>
+// The capacity is multiplied by GrowthPercent% in each expansion. Unless it is 200, the capacity is not a power
+// of two, so the hash values are mapped to the slots with fast_range() instead of masks.
+template <uint32_t MaxFactor = 90, typename Hasher = hash::vigna_hasher, uint32_t GrowthPercent = 200>
 class plain_fkhash_trie {
     static_assert(0 < MaxFactor and MaxFactor < 100);
+    static_assert(100 < GrowthPercent and GrowthPercent <= 200);
 
   public:
-    using this_type = plain_fkhash_trie<MaxFactor, Hasher>;
+    using this_type = plain_fkhash_trie<MaxFactor, Hasher, GrowthPercent>;
 
     static constexpr uint64_t nil_id = UINT64_MAX;
     static constexpr uint32_t min_capa_bits = 16;
+    static constexpr uint32_t max_factor = MaxFactor;
+    static constexpr uint32_t growth_percent = GrowthPercent;
 
     static constexpr auto trie_type_id = trie_type_ids::FKHASH_TRIE;
 
   public:
     plain_fkhash_trie() = default;
 
-    plain_fkhash_trie(uint32_t capa_bits, uint32_t symb_bits) {
-        capa_size_ = size_p2{std::max(min_capa_bits, capa_bits)};
-        symb_size_ = size_p2{symb_bits};
-        max_size_ = static_cast<uint64_t>(capa_size_.size() * MaxFactor / 100.0);
-        table_ = compact_vector{capa_size_.size(), capa_size_.bits() + symb_size_.bits()};
-        ids_ = compact_vector{capa_size_.size(), capa_size_.bits()};
-    }
+    plain_fkhash_trie(uint32_t capa_bits, uint32_t symb_bits)
+        : plain_fkhash_trie{1ULL << std::max(min_capa_bits, capa_bits), symb_bits, 0} {}
 
     ~plain_fkhash_trie() = default;
 
@@ -71,7 +72,7 @@ class plain_fkhash_trie {
     }
 
     uint64_t find_child(uint64_t node_id, uint64_t symb) const {
-        assert(node_id < capa_size_.size());
+        assert(node_id < capa_size_);
         assert(symb < symb_size_.size());
 
         if (size_ == 0) {
@@ -93,7 +94,7 @@ class plain_fkhash_trie {
     }
 
     bool add_child(uint64_t& node_id, uint64_t symb) {
-        assert(node_id < capa_size_.size());
+        assert(node_id < capa_size_);
         assert(symb < symb_size_.size());
 
         if (max_size() <= size()) {
@@ -123,6 +124,24 @@ class plain_fkhash_trie {
         }
     }
 
+    // Calls fn(parent, symb, child) for every edge in the slot order.
+    template <typename Fn>
+    void for_each_edge(Fn fn) const {
+        for (uint64_t i = 0; i < capa_size_; ++i) {
+            uint64_t child_id = ids_[i];
+            if (child_id == 0) {  // empty?
+                continue;
+            }
+            uint64_t key = table_[i];
+            fn(key >> symb_size_.bits(), key & symb_size_.mask(), child_id);
+        }
+    }
+
+    // Rebuilds the trie with 2**capa_bits slots. The node IDs are kept.
+    void resize(uint32_t capa_bits) {
+        resize_(1ULL << std::max(min_capa_bits, capa_bits));
+    }
+
     // # of registerd nodes
     uint64_t size() const {
         return size_;
@@ -131,10 +150,11 @@ class plain_fkhash_trie {
         return max_size_;
     }
     uint64_t capa_size() const {
-        return capa_size_.size();
+        return capa_size_;
     }
+    // Gets the bits of the node IDs.
     uint32_t capa_bits() const {
-        return capa_size_.bits();
+        return capa_bits_;
     }
     uint64_t symb_size() const {
         return symb_size_.size();
@@ -154,6 +174,15 @@ class plain_fkhash_trie {
         return bytes;
     }
 
+    // Estimates alloc_bytes() just after construction with the given parameters.
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint32_t symb_bits) {
+        capa_bits = std::max(min_capa_bits, capa_bits);
+        uint64_t bytes = 0;
+        bytes += bit_tools::words_for((1ULL << capa_bits) * (capa_bits + symb_bits)) * sizeof(uint64_t);
+        bytes += bit_tools::words_for((1ULL << capa_bits) * capa_bits) * sizeof(uint64_t);
+        return bytes;
+    }
+
     void show_stats(std::ostream& os, int n = 0) const {
         auto indent = get_indent(n);
         show_stat(os, indent, "name", "plain_fkhash_trie");
@@ -161,6 +190,7 @@ class plain_fkhash_trie {
         show_stat(os, indent, "max_factor", MaxFactor);
         show_stat(os, indent, "size", size());
         show_stat(os, indent, "alloc_bytes", alloc_bytes());
+        show_stat(os, indent, "capa_size", capa_size());
         show_stat(os, indent, "capa_bits", capa_bits());
         show_stat(os, indent, "symb_bits", symb_bits());
 #ifdef POPLAR_EXTRA_STATS
@@ -179,7 +209,8 @@ class plain_fkhash_trie {
     compact_vector ids_;
     uint64_t size_ = 0;  // # of registered nodes
     uint64_t max_size_ = 0;  // MaxFactor% of the capacity
-    size_p2 capa_size_;
+    uint64_t capa_size_ = 0;
+    uint32_t capa_bits_ = 0;  // ceil(log2(capa_size_))
     size_p2 symb_size_;
 #ifdef POPLAR_EXTRA_STATS
     uint64_t num_resize_ = 0;
@@ -188,20 +219,69 @@ class plain_fkhash_trie {
     uint64_t make_key_(uint64_t node_id, uint64_t symb) const {
         return (node_id << symb_size_.bits()) | symb;
     }
+    // Only for resize_()
+    plain_fkhash_trie(uint64_t capa_size, uint32_t symb_bits, int) {
+        capa_size_ = capa_size;
+        capa_bits_ = bit_tools::ceil_log2(capa_size);
+        symb_size_ = size_p2{symb_bits};
+        max_size_ = static_cast<uint64_t>(capa_size_ * MaxFactor / 100.0);
+        table_ = compact_vector{capa_size_, capa_bits_ + symb_size_.bits()};
+        ids_ = compact_vector{capa_size_, capa_bits_};
+    }
+
     uint64_t init_id_(uint64_t key) const {
-        return Hasher::hash(key) & capa_size_.mask();
+        if constexpr (GrowthPercent == 200) {
+            return Hasher::hash(key) & (capa_size_ - 1);
+        } else {
+            return hash::fast_range(Hasher::hash(key), capa_size_);
+        }
     }
     uint64_t right_(uint64_t slot_id) const {
-        return (slot_id + 1) & capa_size_.mask();
+        if constexpr (GrowthPercent == 200) {
+            return (slot_id + 1) & (capa_size_ - 1);
+        } else {
+            return slot_id + 1 == capa_size_ ? 0 : slot_id + 1;
+        }
     }
 
     void expand_() {
-        this_type new_ht{capa_bits() + 1, symb_bits()};
+        resize_(std::max(capa_size_ + 1, capa_size_ * GrowthPercent / 100));
+    }
+    // Rebuilds the trie with capa_size slots.
+    void resize_(uint64_t capa_size) {
+        this_type new_ht{capa_size, symb_bits(), 0};
+        POPLAR_THROW_IF(new_ht.max_size() <= size(), "capa_bits is too small to store the nodes.");
 #ifdef POPLAR_EXTRA_STATS
         new_ht.num_resize_ = num_resize_ + 1;
 #endif
 
-        for (uint64_t i = 0; i < capa_size_.size(); ++i) {
+        // The entries are reinserted in batches whose home slots are prefetched in advance
+        // because they are scattered over the new table.
+        constexpr uint64_t batch_size = 64;
+        uint64_t keys[batch_size];
+        uint64_t child_ids[batch_size];
+        uint64_t init_ids[batch_size];
+        uint64_t num_keys = 0;
+
+        auto flush = [&]() {
+            for (uint64_t j = 0; j < num_keys; ++j) {
+                init_ids[j] = new_ht.init_id_(keys[j]);
+                new_ht.table_.prefetch(init_ids[j]);
+                new_ht.ids_.prefetch(init_ids[j]);
+            }
+            for (uint64_t j = 0; j < num_keys; ++j) {
+                for (uint64_t new_i = init_ids[j];; new_i = new_ht.right_(new_i)) {
+                    if (new_ht.ids_[new_i] == 0) {  // empty?
+                        new_ht.table_.set(new_i, keys[j]);
+                        new_ht.ids_.set(new_i, child_ids[j]);
+                        break;
+                    }
+                }
+            }
+            num_keys = 0;
+        };
+
+        for (uint64_t i = 0; i < capa_size_; ++i) {
             uint64_t child_id = ids_[i];
             if (child_id == 0) {  // empty?
                 continue;
@@ -210,14 +290,13 @@ class plain_fkhash_trie {
             uint64_t key = table_[i];
             assert(key != 0);
 
-            for (uint64_t new_i = new_ht.init_id_(key);; new_i = new_ht.right_(new_i)) {
-                if (new_ht.ids_[new_i] == 0) {  // empty?
-                    new_ht.table_.set(new_i, key);
-                    new_ht.ids_.set(new_i, child_id);
-                    break;
-                }
+            keys[num_keys] = key;
+            child_ids[num_keys] = child_id;
+            if (++num_keys == batch_size) {
+                flush();
             }
         }
+        flush();
 
         new_ht.size_ = size_;
         *this = std::move(new_ht);
@@ -0,0 +1,235 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_RS_BIT_VECTOR_HPP
+#define POPLAR_TRIE_RS_BIT_VECTOR_HPP
+
+#include <algorithm>
+#include <iostream>
+
+#include "bit_vector.hpp"
+
+namespace poplar {
+
+// This class implements a bit vector supporting rank and select based on rank9 by Vigna.
+// For each 512-bit block, the absolute count of 1s and the seven relative counts of the 64-bit words are
+// interleaved in two words so that rank touches one cache line of counts. Select finds the block with the
+// help of the blocks of every 512-th 1 (or 0), and then the word with the relative counts.
+class rs_bit_vector {
+  public:
+    rs_bit_vector() = default;
+
+    explicit rs_bit_vector(bit_vector&& bv) : bv_{std::move(bv)} {
+        build_();
+    }
+
+    ~rs_bit_vector() = default;
+
+    bool operator[](uint64_t i) const {
+        return bv_.get(i);
+    }
+    bool get(uint64_t i) const {
+        return bv_.get(i);
+    }
+    uint64_t get_bits(uint64_t pos, uint32_t len) const {
+        return bv_.get_bits(pos, len);
+    }
+
+    // Gets the number of 1s in [0..i).
+    uint64_t rank1(uint64_t i) const {
+        assert(i <= size());
+
+        auto [block_id, pos_in_block] = decompose_value<512>(i);
+        const uint64_t word_id = pos_in_block / 64;
+
+        uint64_t rank = counts_[block_id * 2] + get_rel_(block_id, word_id);
+        if (i % 64 != 0) {
+            rank += bit_tools::popcnt(bv_.data()[i / 64], i % 64);
+        }
+        return rank;
+    }
+    // Gets the number of 0s in [0..i).
+    uint64_t rank0(uint64_t i) const {
+        return i - rank1(i);
+    }
+
+    // Gets the position of the (k+1)-th 1.
+    uint64_t select1(uint64_t k) const {
+        assert(k < num_ones());
+
+        uint64_t block_id = search_block_(k, hints1_, [&](uint64_t b) { return counts_[b * 2]; });
+        k -= counts_[block_id * 2];
+
+        uint64_t word_id = count_words_(counts_[block_id * 2 + 1], k);
+        k -= get_rel_(block_id, word_id);
+
+        const uint64_t i = block_id * 8 + word_id;
+        return i * 64 + bit_tools::select(bv_.data()[i], k + 1);
+    }
+    // Gets the position of the (k+1)-th 0.
+    uint64_t select0(uint64_t k) const {
+        assert(k < size() - num_ones());
+
+        uint64_t block_id = search_block_(k, hints0_, [&](uint64_t b) { return b * 512 - counts_[b * 2]; });
+        k -= block_id * 512 - counts_[block_id * 2];
+
+        uint64_t word_id = count_words_(bits_step_9 - counts_[block_id * 2 + 1], k);
+        k -= word_id * 64 - get_rel_(block_id, word_id);
+
+        const uint64_t i = block_id * 8 + word_id;
+        return i * 64 + bit_tools::select(~bv_.data()[i], k + 1);
+    }
+
+    uint64_t size() const {
+        return bv_.size();
+    }
+    uint64_t num_ones() const {
+        return counts_.empty() ? 0 : counts_[counts_.size() - 2];
+    }
+    uint64_t alloc_bytes() const {
+        uint64_t bytes = 0;
+        bytes += bv_.alloc_bytes();
+        bytes += counts_.capacity() * sizeof(uint64_t);
+        bytes += hints1_.capacity() * sizeof(uint64_t);
+        bytes += hints0_.capacity() * sizeof(uint64_t);
+        return bytes;
+    }
+
+    // Only the bits are written, and the indexes are rebuilt in load().
+    void save(std::ostream& os) const {
+        bv_.save(os);
+    }
+    void load(std::istream& is) {
+        bv_.load(is);
+        build_();
+    }
+
+    rs_bit_vector(const rs_bit_vector&) = delete;
+    rs_bit_vector& operator=(const rs_bit_vector&) = delete;
+
+    rs_bit_vector(rs_bit_vector&& rhs) noexcept = default;
+    rs_bit_vector& operator=(rs_bit_vector&& rhs) noexcept = default;
+
+  private:
+    static constexpr uint64_t ones_step_9 = 0x0040201008040201ULL;  // 1 in each of the seven 9-bit fields
+    static constexpr uint64_t msbs_step_9 = 0x100ULL * ones_step_9;
+    static constexpr uint64_t bits_step_9 = 0x7030140803010040ULL;  // 64 * (j + 1) in the j-th field
+
+    bit_vector bv_;
+    std::vector<uint64_t> counts_;  // (absolute count, 9-bit relative counts) for each block
+    std::vector<uint64_t> hints1_;  // block of every 512-th 1
+    std::vector<uint64_t> hints0_;  // block of every 512-th 0
+
+    // Gets the number of 1s in the first word_id words of the block.
+    uint64_t get_rel_(uint64_t block_id, uint64_t word_id) const {
+        assert(word_id < 8);
+        return word_id == 0 ? 0 : (counts_[block_id * 2 + 1] >> (9 * (word_id - 1))) & 0x1FF;
+    }
+
+    // Gets the number of the 9-bit fields in rels no more than k, i.e., the word including the (k+1)-th bit
+    // of the relative counts, by comparing the fields in parallel (ULEQ_STEP_9 of Vigna).
+    static uint64_t count_words_(uint64_t rels, uint64_t k) {
+        const uint64_t ks = k * ones_step_9;
+        const uint64_t leq = (((((ks | msbs_step_9) - (rels & ~msbs_step_9)) | (rels ^ ks)) ^ (rels & ~ks)) & msbs_step_9) >> 8;
+        return (leq * ones_step_9 >> 54) & 0x7;
+    }
+
+    // Finds the last block whose preceding count is no more than k.
+    template <typename Count>
+    uint64_t search_block_(uint64_t k, const std::vector<uint64_t>& hints, Count count) const {
+        uint64_t lo = hints[k / 512], hi = hints[k / 512 + 1] + 1;
+        while (lo + 8 < hi) {
+            uint64_t mid = (lo + hi) / 2;
+            if (count(mid) <= k) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        // The range is usually a few blocks, in which a linear scan is cheaper.
+        while (lo + 1 < hi and count(lo + 1) <= k) {
+            ++lo;
+        }
+        return lo;
+    }
+
+    void build_() {
+        const uint64_t num_words = bv_.num_words();
+        const uint64_t num_blocks = (num_words + 7) / 8;
+        const uint64_t* words = bv_.data();
+
+        counts_.clear();
+        counts_.reserve((num_blocks + 1) * 2);
+
+        // The popcounts are computed in bulk for a chunk of blocks, with AVX-512 if available.
+        constexpr uint64_t chunk_blocks = 64;
+        uint64_t pops[chunk_blocks * 8] = {};
+
+        uint64_t sum = 0;
+        for (uint64_t block_id = 0; block_id < num_blocks; ++block_id) {
+            if (block_id % chunk_blocks == 0) {
+                const uint64_t begin = block_id * 8;
+                const uint64_t n = std::min(num_words - begin, chunk_blocks * 8);
+                bit_tools::popcnt_words(words + begin, n, pops);
+                std::fill(pops + n, pops + chunk_blocks * 8, 0);
+            }
+            const uint64_t* block_pops = pops + (block_id % chunk_blocks) * 8;
+
+            uint64_t rel = 0, rels = 0;
+            for (uint64_t word_id = 0; word_id < 8; ++word_id) {
+                if (word_id != 0) {
+                    rels |= rel << (9 * (word_id - 1));
+                }
+                rel += block_pops[word_id];
+            }
+            counts_.push_back(sum);
+            counts_.push_back(rels);
+            sum += rel;
+        }
+        counts_.push_back(sum);
+        counts_.push_back(0);
+
+        hints1_.clear();
+        hints0_.clear();
+        for (uint64_t block_id = 0; block_id < num_blocks; ++block_id) {
+            const uint64_t ones = counts_[block_id * 2 + 2];
+            const uint64_t zeros = std::min(size(), (block_id + 1) * 512) - ones;
+            while (hints1_.size() * 512 < ones) {
+                hints1_.push_back(block_id);
+            }
+            while (hints0_.size() * 512 < zeros) {
+                hints0_.push_back(block_id);
+            }
+        }
+        hints1_.push_back(num_blocks == 0 ? 0 : num_blocks - 1);
+        hints0_.push_back(num_blocks == 0 ? 0 : num_blocks - 1);
+
+        counts_.shrink_to_fit();
+        hints1_.shrink_to_fit();
+        hints0_.shrink_to_fit();
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_RS_BIT_VECTOR_HPP
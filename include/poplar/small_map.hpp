@@ -0,0 +1,258 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_SMALL_MAP_HPP
+#define POPLAR_TRIE_SMALL_MAP_HPP
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+
+#include "exception.hpp"
+#include "hash.hpp"
+#include "vbyte.hpp"
+
+namespace poplar {
+
+// This class implements an updatable associative array that keeps at most MaxSmallSize keys in small arrays
+// and moves them to Map when more keys are inserted. Since Map allocates the hash table of 2**min_capa_bits
+// slots, this saves the space of many small maps. In the small arrays, the keys are appended to a byte array as
+// vbyte(length) followed by the characters, and are searched through an open addressing table of their IDs.
+template <typename Map, uint32_t MaxSmallSize = 256>
+class small_map {
+    static_assert(0 < MaxSmallSize and MaxSmallSize < UINT16_MAX);
+    static_assert(std::is_same_v<typename Map::value_pointer, typename Map::value_type*>);
+
+  public:
+    using this_type = small_map<Map, MaxSmallSize>;
+    using map_type = Map;
+    using value_type = typename Map::value_type;
+    using value_pointer = typename Map::value_pointer;
+    using const_value_pointer = typename Map::const_value_pointer;
+
+    static constexpr uint32_t max_small_size = MaxSmallSize;
+
+  public:
+    // Generic constructor.
+    small_map() = default;
+
+    // Class constructor. Map is built with the parameters when the keys are moved.
+    explicit small_map(uint32_t capa_bits, uint64_t lambda = 32) : capa_bits_{capa_bits}, lambda_{lambda} {
+        POPLAR_THROW_IF(!is_power2(lambda), "lambda must be a power of 2.");
+    }
+
+    // Generic destructor.
+    ~small_map() = default;
+
+    // Searches the given key and returns the value pointer if registered;
+    // otherwise returns nullptr.
+    const_value_pointer find(const std::string& key) const {
+        return find(make_char_range(key));
+    }
+    const_value_pointer find(char_range key) const {
+        if (map_) {
+            return map_->find(key);
+        }
+        POPLAR_THROW_IF(key.empty(), "key must be a non-empty string.");
+        POPLAR_THROW_IF(*(key.end - 1) != '\0', "The last character of key must be the null terminator.");
+
+        const uint64_t slot = find_slot_(key);
+        return table_.empty() or table_[slot] == 0 ? nullptr : &values_[table_[slot] - 1];
+    }
+
+    // Inserts the given key and returns the value pointer. While the keys are in the small arrays, the values are
+    // kept in a vector growing on demand, so any insertion of a new key can invalidate the value pointers returned
+    // before, which is a weaker guarantee than that of Map. All of them are invalidated when the keys are moved.
+    value_pointer update(const std::string& key) {
+        return update(make_char_range(key));
+    }
+    value_pointer update(char_range key) {
+        if (map_) {
+            return map_->update(key);
+        }
+        POPLAR_THROW_IF(key.empty(), "key must be a non-empty string.");
+        POPLAR_THROW_IF(*(key.end - 1) != '\0', "The last character of key must be the null terminator.");
+
+        if (!table_.empty()) {
+            const uint64_t slot = find_slot_(key);
+            if (table_[slot] != 0) {
+                return &values_[table_[slot] - 1];
+            }
+        }
+
+        if (values_.size() == MaxSmallSize) {
+            move_to_map_();
+            return map_->update(key);
+        }
+
+        if (table_.size() <= values_.size() * 2) {
+            rehash_(std::max<uint64_t>(4, table_.size() * 2));
+        }
+
+        const uint64_t slot = find_slot_(key);
+        offsets_.push_back(static_cast<uint32_t>(keys_.size()));
+        vbyte::append(keys_, key.length() - 1);
+        keys_.insert(keys_.end(), key.begin, key.end - 1);
+        values_.emplace_back();
+        table_[slot] = static_cast<uint16_t>(values_.size());
+        return &values_.back();
+    }
+
+    // Calls fn(key, value) for every registered key in no particular order, where key is given as
+    // std::string_view without the terminator.
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        if (map_) {
+            map_->enumerate(fn);
+            return;
+        }
+        for (uint64_t i = 0; i < values_.size(); ++i) {
+            const value_type& value = values_[i];
+            fn(get_key_(i), value);
+        }
+    }
+    // Same as above but the values can be modified.
+    template <typename Fn>
+    void enumerate(Fn fn) {
+        if (map_) {
+            map_->enumerate(fn);
+            return;
+        }
+        for (uint64_t i = 0; i < values_.size(); ++i) {
+            fn(get_key_(i), values_[i]);
+        }
+    }
+
+    // Checks if the keys are still kept in the small arrays.
+    bool is_small() const {
+        return !map_;
+    }
+    // Gets the map after the keys are moved, or nullptr.
+    const map_type* get_map() const {
+        return map_.get();
+    }
+
+    // Gets the number of registered keys.
+    uint64_t size() const {
+        return map_ ? map_->size() : values_.size();
+    }
+    uint64_t alloc_bytes() const {
+        if (map_) {
+            return map_->alloc_bytes();
+        }
+        uint64_t bytes = 0;
+        bytes += keys_.capacity();
+        bytes += offsets_.capacity() * sizeof(uint32_t);
+        bytes += values_.capacity() * sizeof(value_type);
+        bytes += table_.capacity() * sizeof(uint16_t);
+        return bytes;
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "small_map");
+        show_stat(os, indent, "max_small_size", MaxSmallSize);
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+        if (map_) {
+            show_member(os, indent, "map_");
+            map_->show_stats(os, n + 1);
+        }
+    }
+
+    small_map(const small_map&) = delete;
+    small_map& operator=(const small_map&) = delete;
+
+    small_map(small_map&&) noexcept = default;
+    small_map& operator=(small_map&&) noexcept = default;
+
+  private:
+    uint32_t capa_bits_ = 0;
+    uint64_t lambda_ = 32;
+
+    std::vector<uint8_t> keys_;  // concatenation of vbyte(length) and the characters of each key
+    std::vector<uint32_t> offsets_;  // of each key in keys_
+    std::vector<value_type> values_;  // of each key
+    std::vector<uint16_t> table_;  // key ID plus one of each slot, or zero if empty
+    std::unique_ptr<map_type> map_;
+
+    std::string_view get_key_(uint64_t i) const {
+        const uint8_t* ptr = keys_.data() + offsets_[i];
+        uint64_t length = 0;
+        ptr += vbyte::decode(ptr, length);
+        return {reinterpret_cast<const char*>(ptr), length};
+    }
+
+    static uint64_t hash_(std::string_view key) {
+        return hash::hash_bytes(reinterpret_cast<const uint8_t*>(key.data()), key.size());
+    }
+
+    // Returns the slot of the key or the empty slot to put it.
+    uint64_t find_slot_(const char_range& key) const {
+        if (table_.empty()) {
+            return 0;
+        }
+        const uint64_t mask = table_.size() - 1;
+        const std::string_view key_view{reinterpret_cast<const char*>(key.begin), key.length() - 1};
+
+        for (uint64_t slot = hash_(key_view) & mask;; slot = (slot + 1) & mask) {
+            if (table_[slot] == 0 or get_key_(table_[slot] - 1) == key_view) {
+                return slot;
+            }
+        }
+    }
+
+    void rehash_(uint64_t table_size) {
+        std::vector<uint16_t> table(table_size);
+        const uint64_t mask = table_size - 1;
+
+        for (uint64_t i = 0; i < values_.size(); ++i) {
+            uint64_t slot = hash_(get_key_(i)) & mask;
+            while (table[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            table[slot] = static_cast<uint16_t>(i + 1);
+        }
+        table_ = std::move(table);
+    }
+
+    void move_to_map_() {
+        auto map = std::make_unique<map_type>(capa_bits_, lambda_);
+        std::string key;
+
+        for (uint64_t i = 0; i < values_.size(); ++i) {
+            key.assign(get_key_(i));
+            *map->update(key) = std::move(values_[i]);
+        }
+
+        map_ = std::move(map);
+        keys_ = {};
+        offsets_ = {};
+        values_ = {};
+        table_ = {};
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_SMALL_MAP_HPP
@@ -0,0 +1,515 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef POPLAR_TRIE_VALUE_ARRAY_NLM_HPP
+#define POPLAR_TRIE_VALUE_ARRAY_NLM_HPP
+
+#include <iostream>
+#include <memory>
+
+#include "compact_vector.hpp"
+#include "exception.hpp"
+
+namespace poplar {
+
+// Values of any type in an aligned array.
+template <typename Value>
+class value_vector {
+  public:
+    using value_type = Value;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+
+    static constexpr bool stable = false;
+
+  public:
+    value_vector() = default;
+
+    explicit value_vector(uint64_t size) : vec_(size) {}
+
+    ~value_vector() = default;
+
+    pointer get(uint64_t i) {
+        assert(i < vec_.size());
+        return &vec_[i];
+    }
+    const_pointer get(uint64_t i) const {
+        assert(i < vec_.size());
+        return &vec_[i];
+    }
+
+    void push_back() {
+        vec_.emplace_back();
+    }
+    // Moves the j-th value of other to the i-th.
+    void move_from(uint64_t i, value_vector& other, uint64_t j) {
+        vec_[i] = std::move(other.vec_[j]);
+    }
+
+    void reserve(uint64_t size) {
+        vec_.reserve(size);
+    }
+    void shrink_to_fit() {
+        vec_.shrink_to_fit();
+    }
+
+    uint64_t size() const {
+        return vec_.size();
+    }
+    uint64_t alloc_bytes() const {
+        return vec_.capacity() * sizeof(value_type);
+    }
+
+    static uint64_t estimate_alloc_bytes(uint64_t size) {
+        return size * sizeof(value_type);
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "value_vector");
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+    }
+
+    value_vector(const value_vector&) = delete;
+    value_vector& operator=(const value_vector&) = delete;
+
+    value_vector(value_vector&&) noexcept = default;
+    value_vector& operator=(value_vector&&) noexcept = default;
+
+  private:
+    std::vector<value_type> vec_;
+};
+
+// Integer values of Bits bits packed in compact_vector. Since the values are not addressable, the pointers
+// and references are proxies holding the position.
+template <uint32_t Bits>
+class packed_value_vector {
+    static_assert(0 < Bits and Bits < 64);
+
+  public:
+    using value_type = uint64_t;
+
+    static constexpr bool stable = false;
+
+    class pointer;
+
+    class reference {
+      public:
+        reference(compact_vector* vec, uint64_t i) : vec_{vec}, i_{i} {}
+
+        operator value_type() const {
+            return vec_->get(i_);
+        }
+        reference& operator=(value_type x) {
+            POPLAR_THROW_IF(x >> Bits != 0, "The value does not fit in the bits.");
+            vec_->set(i_, x);
+            return *this;
+        }
+        reference& operator=(const reference& rhs) {
+            return *this = static_cast<value_type>(rhs);
+        }
+        reference& operator+=(value_type x) {
+            return *this = static_cast<value_type>(*this) + x;
+        }
+
+      private:
+        compact_vector* vec_;
+        uint64_t i_;
+    };
+
+    class const_pointer {
+      public:
+        const_pointer() = default;
+        const_pointer(std::nullptr_t) {}
+        const_pointer(const compact_vector* vec, uint64_t i) : vec_{vec}, i_{i} {}
+
+        value_type operator*() const {
+            return vec_->get(i_);
+        }
+        explicit operator bool() const {
+            return vec_ != nullptr;
+        }
+        bool operator==(std::nullptr_t) const {
+            return vec_ == nullptr;
+        }
+        bool operator!=(std::nullptr_t) const {
+            return vec_ != nullptr;
+        }
+
+      private:
+        const compact_vector* vec_ = nullptr;
+        uint64_t i_ = 0;
+
+        friend class pointer;
+    };
+
+    class pointer {
+      public:
+        pointer() = default;
+        pointer(std::nullptr_t) {}
+        pointer(compact_vector* vec, uint64_t i) : vec_{vec}, i_{i} {}
+        // Same as const_cast for the values owned by a non-const container.
+        explicit pointer(const const_pointer& ptr) : vec_{const_cast<compact_vector*>(ptr.vec_)}, i_{ptr.i_} {}
+
+        reference operator*() const {
+            return {vec_, i_};
+        }
+        operator const_pointer() const {
+            return {vec_, i_};
+        }
+        explicit operator bool() const {
+            return vec_ != nullptr;
+        }
+        bool operator==(std::nullptr_t) const {
+            return vec_ == nullptr;
+        }
+        bool operator!=(std::nullptr_t) const {
+            return vec_ != nullptr;
+        }
+
+      private:
+        compact_vector* vec_ = nullptr;
+        uint64_t i_ = 0;
+    };
+
+  public:
+    packed_value_vector() = default;
+
+    explicit packed_value_vector(uint64_t size) : vec_{size, Bits} {}
+
+    ~packed_value_vector() = default;
+
+    pointer get(uint64_t i) {
+        assert(i < vec_.size());
+        return {&vec_, i};
+    }
+    const_pointer get(uint64_t i) const {
+        assert(i < vec_.size());
+        return {&vec_, i};
+    }
+
+    void push_back() {
+        if (vec_.width() == 0) {
+            vec_ = compact_vector{0, Bits};
+        }
+        vec_.resize(vec_.size() + 1);
+        vec_.set(vec_.size() - 1, 0);
+    }
+    // Moves the j-th value of other to the i-th.
+    void move_from(uint64_t i, packed_value_vector& other, uint64_t j) {
+        vec_.set(i, other.vec_.get(j));
+    }
+
+    void reserve(uint64_t size) {
+        if (vec_.width() == 0) {
+            vec_ = compact_vector{0, Bits};
+        }
+        vec_.reserve(size);
+    }
+    void shrink_to_fit() {
+        vec_.shrink_to_fit();
+    }
+
+    uint64_t size() const {
+        return vec_.size();
+    }
+    uint64_t alloc_bytes() const {
+        return vec_.alloc_bytes();
+    }
+
+    static uint64_t estimate_alloc_bytes(uint64_t size) {
+        return bit_tools::words_for(size * Bits) * sizeof(uint64_t);
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "packed_value_vector");
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "bits", Bits);
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+    }
+
+    packed_value_vector(const packed_value_vector&) = delete;
+    packed_value_vector& operator=(const packed_value_vector&) = delete;
+
+    packed_value_vector(packed_value_vector&&) noexcept = default;
+    packed_value_vector& operator=(packed_value_vector&&) noexcept = default;
+
+  private:
+    compact_vector vec_;
+};
+
+// Values of any type in slabs of 2**SlabBits values. Since the slabs are never reallocated, the pointers to the
+// values stay valid while the container lives. Note that a map rebuilt into a new container, i.e., when its
+// learned codes are widened, gives new pointers.
+template <typename Value, uint32_t SlabBits = 12>
+class slab_value_vector {
+  public:
+    using value_type = Value;
+    using pointer = value_type*;
+    using const_pointer = const value_type*;
+
+    static constexpr bool stable = true;
+    static constexpr uint64_t slab_size = 1ULL << SlabBits;
+
+  public:
+    slab_value_vector() = default;
+
+    explicit slab_value_vector(uint64_t size) {
+        for (uint64_t i = 0; i < size; ++i) {
+            push_back();
+        }
+    }
+
+    ~slab_value_vector() = default;
+
+    pointer get(uint64_t i) {
+        assert(i < size_);
+        auto [slab_id, pos_in_slab] = decompose_value<slab_size>(i);
+        return &slabs_[slab_id][pos_in_slab];
+    }
+    const_pointer get(uint64_t i) const {
+        assert(i < size_);
+        auto [slab_id, pos_in_slab] = decompose_value<slab_size>(i);
+        return &slabs_[slab_id][pos_in_slab];
+    }
+
+    void push_back() {
+        if (size_ == slabs_.size() * slab_size) {
+            slabs_.emplace_back(std::make_unique<value_type[]>(slab_size));
+        }
+        ++size_;
+    }
+    // Moves the j-th value of other to the i-th.
+    void move_from(uint64_t i, slab_value_vector& other, uint64_t j) {
+        *get(i) = std::move(*other.get(j));
+    }
+
+    void reserve(uint64_t size) {
+        slabs_.reserve((size + slab_size - 1) / slab_size);
+    }
+    void shrink_to_fit() {
+        slabs_.shrink_to_fit();
+    }
+
+    uint64_t size() const {
+        return size_;
+    }
+    uint64_t alloc_bytes() const {
+        return slabs_.capacity() * sizeof(std::unique_ptr<value_type[]>) + slabs_.size() * slab_size * sizeof(value_type);
+    }
+
+    static uint64_t estimate_alloc_bytes(uint64_t size) {
+        const uint64_t num_slabs = (size + slab_size - 1) / slab_size;
+        return num_slabs * (sizeof(std::unique_ptr<value_type[]>) + slab_size * sizeof(value_type));
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "slab_value_vector");
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "num_slabs", slabs_.size());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+    }
+
+    slab_value_vector(const slab_value_vector&) = delete;
+    slab_value_vector& operator=(const slab_value_vector&) = delete;
+
+    slab_value_vector(slab_value_vector&&) noexcept = default;
+    slab_value_vector& operator=(slab_value_vector&&) noexcept = default;
+
+  private:
+    std::vector<std::unique_ptr<value_type[]>> slabs_;
+    uint64_t size_ = 0;
+};
+
+// NLM storing the labels in LabelNLM without values and the values in a separate array of Values indexed by
+// the node IDs. The values need not be trivially copyable and can be updated without touching the labels.
+// If Values is stable, the values are never moved, so the value pointers stay valid across expand(). Since the
+// node IDs of BONSAI_TRIE change in expand(), the values are then appended and indexed via the slot of each node.
+template <typename LabelNLM, typename Values>
+class value_array_nlm {
+    static_assert(std::is_same_v<typename LabelNLM::value_type, no_value>);
+
+  public:
+    using this_type = value_array_nlm<LabelNLM, Values>;
+    using label_nlm_type = LabelNLM;
+    using value_type = typename Values::value_type;
+    using value_pointer = typename Values::pointer;
+    using const_value_pointer = typename Values::const_pointer;
+
+    static constexpr auto trie_type_id = LabelNLM::trie_type_id;
+    static constexpr bool stable_values = Values::stable;
+    static constexpr uint32_t key_bytes = LabelNLM::key_bytes;
+
+  private:
+    static constexpr bool uses_slots_ = Values::stable and trie_type_id == trie_type_ids::BONSAI_TRIE;
+
+  public:
+    value_array_nlm() = default;
+
+    explicit value_array_nlm(uint32_t capa_bits) : labels_{capa_bits} {
+        if constexpr (uses_slots_) {
+            slots_ = compact_vector{1ULL << capa_bits, capa_bits};
+        } else if constexpr (trie_type_id == trie_type_ids::BONSAI_TRIE) {
+            values_ = Values{1ULL << capa_bits};
+        } else {
+            values_.reserve(1ULL << capa_bits);
+        }
+    }
+
+    ~value_array_nlm() = default;
+
+    std::pair<const_value_pointer, uint64_t> compare(uint64_t pos, const char_range& key) const {
+        auto [vptr, match] = labels_.compare(pos, key);
+        if (vptr == nullptr) {
+            return {nullptr, match};
+        }
+        return {values_.get(get_value_id_(pos)), match};
+    }
+
+    char_range get_label(uint64_t pos) const {
+        return labels_.get_label(pos);
+    }
+    char_range get_label(uint64_t pos, uint64_t length) const {
+        return labels_.get_label(pos, length);
+    }
+
+    // For BONSAI_TRIE
+    value_pointer insert(uint64_t pos, const char_range& key) {
+        labels_.insert(pos, key);
+        if constexpr (uses_slots_) {
+            slots_.set(pos, values_.size());
+            values_.push_back();
+            return values_.get(values_.size() - 1);
+        }
+        return values_.get(pos);
+    }
+
+    template <typename T>
+    void expand(const T& pos_map) {
+        resize(pos_map, bit_tools::ceil_log2(pos_map.size() * 2));
+    }
+
+    template <typename T>
+    void resize(const T& pos_map, uint32_t capa_bits) {
+        labels_.resize(pos_map, capa_bits);
+
+        if constexpr (uses_slots_) {
+            compact_vector new_slots{1ULL << capa_bits, capa_bits};
+            for (uint64_t i = 0; i < pos_map.size(); ++i) {
+                if (pos_map[i] != UINT64_MAX) {
+                    new_slots.set(pos_map[i], slots_[i]);
+                }
+            }
+            slots_ = std::move(new_slots);
+            return;
+        }
+
+        Values new_values{1ULL << capa_bits};
+        for (uint64_t i = 0; i < pos_map.size(); ++i) {
+            if (pos_map[i] != UINT64_MAX) {
+                new_values.move_from(pos_map[i], values_, i);
+            }
+        }
+        values_ = std::move(new_values);
+    }
+
+    // For FKHASH_TRIE
+    value_pointer append(const char_range& key) {
+        labels_.append(key);
+        values_.push_back();
+        return values_.get(values_.size() - 1);
+    }
+
+    void append_dummy() {
+        labels_.append_dummy();
+        values_.push_back();
+    }
+
+    // Reserves the space for num_nodes nodes.
+    void reserve(uint64_t num_nodes) {
+        labels_.reserve(num_nodes);
+        values_.reserve(num_nodes);
+    }
+
+    void shrink_to_fit() {
+        labels_.shrink_to_fit();
+        values_.shrink_to_fit();
+    }
+
+    uint64_t size() const {
+        return labels_.size();
+    }
+    uint64_t alloc_bytes() const {
+        return labels_.alloc_bytes() + values_.alloc_bytes() + slots_.alloc_bytes();
+    }
+
+    static uint64_t estimate_alloc_bytes(uint32_t capa_bits, uint64_t num_labels, uint64_t label_bytes) {
+        uint64_t bytes = LabelNLM::estimate_alloc_bytes(capa_bits, num_labels, label_bytes);
+        if constexpr (uses_slots_) {
+            bytes += Values::estimate_alloc_bytes(num_labels);
+            bytes += bit_tools::words_for((1ULL << capa_bits) * capa_bits) * sizeof(uint64_t);
+        } else {
+            bytes += Values::estimate_alloc_bytes(1ULL << capa_bits);
+        }
+        return bytes;
+    }
+
+    void show_stats(std::ostream& os, int n = 0) const {
+        auto indent = get_indent(n);
+        show_stat(os, indent, "name", "value_array_nlm");
+        show_stat(os, indent, "size", size());
+        show_stat(os, indent, "alloc_bytes", alloc_bytes());
+        show_member(os, indent, "labels_");
+        labels_.show_stats(os, n + 1);
+        show_member(os, indent, "values_");
+        values_.show_stats(os, n + 1);
+        if constexpr (uses_slots_) {
+            show_stat(os, indent, "slots_bytes", slots_.alloc_bytes());
+        }
+    }
+
+    value_array_nlm(const value_array_nlm&) = delete;
+    value_array_nlm& operator=(const value_array_nlm&) = delete;
+
+    value_array_nlm(value_array_nlm&&) noexcept = default;
+    value_array_nlm& operator=(value_array_nlm&&) noexcept = default;
+
+  private:
+    LabelNLM labels_;
+    Values values_;
+    compact_vector slots_;  // value ID of each node if uses_slots_
+
+    uint64_t get_value_id_(uint64_t pos) const {
+        if constexpr (uses_slots_) {
+            return slots_[pos];
+        }
+        return pos;
+    }
+};
+
+}  // namespace poplar
+
+#endif  // POPLAR_TRIE_VALUE_ARRAY_NLM_HPP
@@ -60,6 +60,12 @@ inline uint64_t encode(uint8_t* codes, uint64_t val) {
 }
 
 inline uint64_t decode(const uint8_t* codes, uint64_t& val) {
+    // Most of the lengths in the NLMs are less than 128, so the branch is well predicted.
+    // A branch-free decode would load 8 bytes at once, which can read past the exactly sized chunks of the NLMs.
+    if (codes[0] < 0x80) {
+        val = codes[0];
+        return 1;
+    }
     val = 0;
     uint64_t i = 0, shift = 0;
     while ((codes[i] & 0x80) != 0) {
@@ -70,6 +76,17 @@ inline uint64_t decode(const uint8_t* codes, uint64_t& val) {
     return i;
 }
 
+// Skips n records each of which consists of vbyte(length) and the following length bytes,
+// and returns the pointer to the next record.
+inline const uint8_t* skip(const uint8_t* codes, uint64_t n) {
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t length = 0;
+        codes += decode(codes, length);
+        codes += length;
+    }
+    return codes;
+}
+
 }  // namespace poplar::vbyte
 
 #endif  // POPLAR_TRIE_VBYTE_HPP
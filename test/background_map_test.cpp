@@ -0,0 +1,171 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <poplar.hpp>
+#include <thread>
+
+#include "test_common.hpp"
+
+namespace {
+
+using namespace poplar;
+using namespace poplar::test;
+
+constexpr uint64_t num_readers = 3;
+
+// Holds the worker in enumerate() until the gate is opened, so that the updates surely go to the delta.
+struct gated_map : plain_bonsai_map<uint64_t> {
+    using plain_bonsai_map<uint64_t>::plain_bonsai_map;
+
+    static inline std::atomic<bool> is_open = true;
+
+    template <typename Fn>
+    void enumerate(Fn fn) const {
+        while (!is_open.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        plain_bonsai_map<uint64_t>::enumerate(fn);
+    }
+};
+
+}  // namespace
+
+template <class>
+class background_map_test : public ::testing::Test {};
+
+using background_map_types = ::testing::Types<background_map<plain_bonsai_map<uint64_t>>,
+                                              background_map<compact_bonsai_map<uint64_t>>,
+                                              background_map<plain_fkhash_map<uint64_t>>,
+                                              background_map<compact_fkhash_map<uint64_t>>>;
+
+TYPED_TEST_SUITE(background_map_test, background_map_types);
+
+TYPED_TEST(background_map_test, Words) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    TypeParam map;
+    std::atomic<uint64_t> num_inserted = 0;
+
+    // The readers search the keys inserted so far while the writer inserts them.
+    std::vector<std::thread> readers;
+    for (uint64_t t = 0; t < num_readers; ++t) {
+        readers.emplace_back([&, t] {
+            for (uint64_t i = t; i < keys.size(); i += num_readers) {
+                while (num_inserted.load(std::memory_order_acquire) <= i) {
+                    std::this_thread::yield();
+                }
+                auto value = map.find(keys[i]);
+                ASSERT_TRUE(value.has_value());
+                ASSERT_EQ(*value, i);
+            }
+        });
+    }
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        map.update(keys[i], i);
+        num_inserted.store(i + 1, std::memory_order_release);
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    map.wait();
+    ASSERT_FALSE(map.is_rebuilding());
+    ASSERT_LT(0, map.num_rebuilds());
+    ASSERT_EQ(map.size(), keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(*map.find(keys[i]), i);
+    }
+    ASSERT_FALSE(map.find("not registered").has_value());
+}
+
+TYPED_TEST(background_map_test, Overwrite) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    TypeParam map;
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        map.update(keys[i], i);
+    }
+    // Some of the keys are overwritten, possibly while rebuilding.
+    for (uint64_t i = 0; i < keys.size(); i += 3) {
+        map.update(keys[i], i + 1);
+    }
+    map.wait();
+
+    ASSERT_EQ(map.size(), keys.size());
+    uint64_t num_keys = 0;
+    map.enumerate([&](std::string_view, uint64_t) { ++num_keys; });
+    ASSERT_EQ(num_keys, keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(*map.find(keys[i]), i % 3 == 0 ? i + 1 : i);
+    }
+}
+
+TEST(background_map_test, OverwriteWhileRebuilding) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    background_map<gated_map> map;
+
+    // Destructed before the map so that the gate is opened before the map joins the worker even on a failure.
+    struct gate_opener {
+        ~gate_opener() {
+            gated_map::is_open = true;
+        }
+    } opener;
+    gated_map::is_open = false;
+
+    uint64_t num_keys = 0;
+    while (!map.is_rebuilding()) {
+        ASSERT_LT(num_keys, keys.size());
+        map.update(keys[num_keys], num_keys);
+        ++num_keys;
+    }
+    const uint64_t num_new_keys = std::min<uint64_t>(100, keys.size() - num_keys);
+
+    // The overwrites go to the delta and do not count as new keys.
+    for (uint64_t i = 0; i < num_keys; i += 3) {
+        map.update(keys[i], i + 1);
+    }
+    ASSERT_EQ(map.size(), num_keys);
+    for (uint64_t i = num_keys; i < num_keys + num_new_keys; ++i) {
+        map.update(keys[i], i);
+        map.update(keys[i], i + 1);  // overwrites the key in the delta
+    }
+    ASSERT_EQ(map.size(), num_keys + num_new_keys);
+    ASSERT_TRUE(map.is_rebuilding());
+    for (uint64_t i = 0; i < num_keys + num_new_keys; ++i) {
+        ASSERT_EQ(*map.find(keys[i]), (i % 3 == 0 or num_keys <= i) ? i + 1 : i);
+    }
+
+    gated_map::is_open = true;
+    map.wait();
+    ASSERT_FALSE(map.is_rebuilding());
+    ASSERT_EQ(map.num_rebuilds(), 1);
+    ASSERT_EQ(map.size(), num_keys + num_new_keys);
+    for (uint64_t i = 0; i < num_keys + num_new_keys; ++i) {
+        ASSERT_EQ(*map.find(keys[i]), (i % 3 == 0 or num_keys <= i) ? i + 1 : i);
+    }
+}
@@ -51,6 +51,28 @@ void check_bijection(uint32_t univ_bits) {
     }
 }
 
+template <typename Hasher>
+void check_batch(uint32_t univ_bits) {
+    Hasher h{univ_bits};
+
+    std::vector<uint64_t> xs(N + 3);  // not a multiple of the SIMD width
+    std::random_device rnd;
+    for (uint64_t i = 0; i < xs.size(); ++i) {
+        xs[i] = ((uint64_t(rnd()) << 32) | rnd()) & (h.size() - 1);
+    }
+
+    std::vector<uint64_t> ys(xs.size());
+    h.hash_n(xs.data(), ys.data(), xs.size());
+    for (uint64_t i = 0; i < xs.size(); ++i) {
+        ASSERT_EQ(h.hash(xs[i]), ys[i]);
+    }
+
+    h.hash_inv_n(ys.data(), ys.data(), ys.size());
+    for (uint64_t i = 0; i < xs.size(); ++i) {
+        ASSERT_EQ(xs[i], ys[i]);
+    }
+}
+
 template <typename>
 class bijective_hash_test : public ::testing::Test {};
 
@@ -64,4 +86,10 @@ TYPED_TEST(bijective_hash_test, Tiny) {
     }
 }
 
+TYPED_TEST(bijective_hash_test, Batch) {
+    for (uint32_t i = 1; i < 64; ++i) {
+        check_batch<TypeParam>(i);
+    }
+}
+
 }  // namespace
@@ -0,0 +1,156 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <array>
+#include <poplar.hpp>
+#include <random>
+
+#include "test_common.hpp"
+
+namespace {
+
+using namespace poplar;
+using namespace poplar::test;
+
+}  // namespace
+
+template <class>
+class binary_key_map_test : public ::testing::Test {};
+
+using binary_key_map_types =
+    ::testing::Types<plain_bonsai_map<uint64_t>, compact_bonsai_map<uint64_t>, plain_fkhash_map<uint64_t>,
+                     compact_fkhash_map<uint64_t>>;
+
+TYPED_TEST_SUITE(binary_key_map_test, binary_key_map_types);
+
+template <typename Map>
+void test_integers(Map& map) {
+    // The small integers have many zero bytes, and the others have all the byte values.
+    std::vector<uint64_t> keys;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        keys.push_back(i);
+        keys.push_back(~i);
+    }
+    std::mt19937_64 engine(13);
+    for (uint64_t i = 0; i < 10000; ++i) {
+        keys.push_back(engine());
+    }
+
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        *map.update(keys[i]) = i;
+    }
+    ASSERT_EQ(map.size(), keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        auto ptr = map.find(keys[i]);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(*ptr, i);
+    }
+    ASSERT_EQ(map.find(uint64_t(1) << 63), nullptr);
+
+    uint64_t num_keys = 0;
+    map.enumerate([&](const uint8_t* key_bytes, uint64_t value) {
+        uint64_t key = 0;
+        std::memcpy(&key, key_bytes, sizeof(key));
+        ASSERT_EQ(key, keys[value]);
+        ++num_keys;
+    });
+    ASSERT_EQ(num_keys, keys.size());
+}
+
+template <typename Map>
+void test_arrays(Map& map) {
+    std::vector<std::array<uint8_t, 16>> keys(5000);
+    std::mt19937 engine(13);
+    for (auto& key : keys) {
+        for (auto& b : key) {
+            // Biased to the escaped bytes
+            b = static_cast<uint8_t>(engine() % 8 == 0 ? 0xFB + engine() % 5 : engine());
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        *map.update(keys[i].data()) = i;
+    }
+    ASSERT_EQ(map.size(), keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(*map.find(keys[i]), i);
+    }
+}
+
+TYPED_TEST(binary_key_map_test, Integers) {
+    binary_key_map<TypeParam, 8> map;
+    test_integers(map);
+}
+
+TYPED_TEST(binary_key_map_test, Arrays) {
+    binary_key_map<TypeParam, 16> map;
+    test_arrays(map);
+}
+
+TEST(binary_key_map_test, FixedLengthKeys) {
+    binary_key_map<fixed_fkhash_map<uint64_t, 8>, 8> integers;
+    static_assert(!decltype(integers)::escapes);
+    test_integers(integers);
+
+    binary_key_map<fixed_fkhash_map<uint64_t, 16>, 16> arrays;
+    test_arrays(arrays);
+
+    // lambda less than the key length makes the step nodes.
+    binary_key_map<fixed_fkhash_map<uint64_t, 16>, 16> stepped{0, 4};
+    test_arrays(stepped);
+
+    using value_array_map =
+        map<plain_fkhash_trie<>, value_array_nlm<fixed_fkhash_nlm<no_value, 8>, value_vector<uint64_t>>>;
+    binary_key_map<value_array_map, 8> value_array;
+    test_integers(value_array);
+}
+
+TEST(binary_key_map_test, FixedLengthMap) {
+    // The records of fixed_fkhash_nlm never move.
+    fixed_fkhash_map<uint64_t, 3> stable_map;
+    ASSERT_THROW(stable_map.enable_auto_lambda(), exception);
+
+    // All the 256 byte values appear at every depth, and the map is rebuilt when lambda is tuned from 2.
+    map<plain_fkhash_trie<>, value_array_nlm<fixed_fkhash_nlm<no_value, 3, 4>, value_vector<uint64_t>>> map{0, 2};
+    map.enable_auto_lambda(1024);
+    ASSERT_EQ(map.code_bits(), 9U);
+    for (uint64_t i = 0; i < (1 << 16); ++i) {
+        const std::string key = {char(i & 0xFF), char(i >> 8), char(i * 7)};
+        *map.update(key) = i;
+    }
+    ASSERT_EQ(map.size(), 1U << 16);
+    ASSERT_NE(map.num_lambda_tunes(), 0U);
+
+    for (uint64_t i = 0; i < (1 << 16); ++i) {
+        const std::string key = {char(i & 0xFF), char(i >> 8), char(i * 7)};
+        auto ptr = map.find(key);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(*ptr, i);
+        ASSERT_EQ(map.find(std::string{char(i & 0xFF), char(i >> 8), char(i * 7 + 1)}), nullptr);
+    }
+    ASSERT_THROW(map.update(std::string(2, 'a')), exception);
+    ASSERT_THROW(map.find(std::string(4, 'a')), exception);
+}
@@ -24,8 +24,10 @@
 #include <gtest/gtest.h>
 #include <poplar.hpp>
 #include <random>
+#include <sstream>
 
 #include <poplar/bit_vector.hpp>
+#include <poplar/rs_bit_vector.hpp>
 
 #include "test_common.hpp"
 
@@ -57,4 +59,175 @@ TEST(bit_vector_test, Tiny) {
     }
 }
 
+void test_rank_select(uint64_t size, uint32_t density) {
+    std::vector<bool> orig;
+    bit_vector bv;
+    {
+        std::mt19937_64 engine(size + density);
+        for (uint64_t i = 0; i < size; ++i) {
+            bool bit = engine() % 100 < density;
+            orig.push_back(bit);
+            bv.append_bit(bit);
+        }
+    }
+
+    rs_bit_vector rsbv{std::move(bv)};
+    ASSERT_EQ(rsbv.size(), size);
+
+    uint64_t rank = 0;
+    for (uint64_t i = 0; i < size; ++i) {
+        ASSERT_EQ(rsbv[i], orig[i]);
+        ASSERT_EQ(rsbv.rank1(i), rank);
+        ASSERT_EQ(rsbv.rank0(i), i - rank);
+        if (orig[i]) {
+            ASSERT_EQ(rsbv.select1(rank), i);
+        } else {
+            ASSERT_EQ(rsbv.select0(i - rank), i);
+        }
+        rank += orig[i];
+    }
+    ASSERT_EQ(rsbv.rank1(size), rank);
+    ASSERT_EQ(rsbv.num_ones(), rank);
+}
+
+TEST(bit_tools_test, Select) {
+    std::mt19937_64 engine(13);
+#ifdef POPLAR_CPU_DISPATCH
+    const auto& features = bit_tools::get_cpu_features();
+#endif
+
+    for (uint64_t n = 0; n < N; ++n) {
+        uint64_t x = engine() & engine();
+        if (x == 0) {
+            continue;
+        }
+        for (uint64_t i = 1, pos = 0; pos < 64; ++pos) {
+            if (bit_tools::get_bit(x, pos)) {
+                ASSERT_EQ(pos, bit_tools::select_broadword(x, i));
+                ASSERT_EQ(pos, bit_tools::select(x, i));
+#ifdef POPLAR_CPU_DISPATCH
+                if (features.bmi2) {
+                    ASSERT_EQ(pos, bit_tools::select_bmi2(x, i));
+                }
+#endif
+                ++i;
+            }
+        }
+    }
+}
+
+TEST(bit_tools_test, PopcntWords) {
+    std::mt19937_64 engine(13);
+    std::vector<uint64_t> words(1000), counts(1001);
+    for (auto& w : words) {
+        w = engine();
+    }
+    // Also covers the lengths not divisible by the vector width
+    for (uint64_t n : {0, 1, 7, 8, 9, 1000}) {
+        std::fill(counts.begin(), counts.end(), UINT64_MAX);
+        bit_tools::popcnt_words(words.data(), n, counts.data());
+        for (uint64_t i = 0; i < n; ++i) {
+            ASSERT_EQ(bit_tools::popcnt(words[i]), counts[i]);
+        }
+        ASSERT_EQ(UINT64_MAX, counts[n]);
+    }
+}
+
+TEST(rs_bit_vector_test, RankSelect) {
+    for (uint32_t density : {1, 10, 50, 90, 99}) {
+        test_rank_select(N, density);
+        test_rank_select(N * 10 + 512, density);
+        test_rank_select(N * 10 + 511, density);
+    }
+}
+
+// Gives the bytes without seeking, so the length of a vector cannot be checked against the stream.
+class unseekable_buf : public std::streambuf {
+  public:
+    explicit unseekable_buf(std::string bytes) : bytes_{std::move(bytes)} {
+        setg(bytes_.data(), bytes_.data(), bytes_.data() + bytes_.size());
+    }
+
+  private:
+    std::string bytes_;
+};
+
+TEST(rs_bit_vector_test, SaveLoad) {
+    std::mt19937_64 engine(13);
+    bit_vector bits;
+    for (uint64_t i = 0; i < N; ++i) {
+        bits.append_bit(engine() % 3 == 0);
+    }
+    rs_bit_vector rs_bits{std::move(bits)};
+    compact_vector values{N, 20};
+    for (uint64_t i = 0; i < N; ++i) {
+        values.set(i, engine() % (1 << 20));
+    }
+
+    std::stringstream ss;
+    rs_bits.save(ss);
+    values.save(ss);
+    const std::string bytes = ss.str();
+
+    {
+        std::stringstream is{bytes};
+        rs_bit_vector loaded_bits;
+        compact_vector loaded_values;
+        loaded_bits.load(is);
+        loaded_values.load(is);
+        ASSERT_EQ(loaded_bits.size(), rs_bits.size());
+        ASSERT_EQ(loaded_bits.num_ones(), rs_bits.num_ones());
+        for (uint64_t i = 0; i < N; ++i) {
+            ASSERT_EQ(loaded_bits[i], rs_bits[i]);
+            ASSERT_EQ(loaded_values[i], values[i]);
+        }
+    }
+
+    // The truncated bytes fail with or without seeking.
+    for (uint64_t length : {uint64_t(4), uint64_t(12), bytes.size() / 2, bytes.size() - 1}) {
+        std::stringstream is{bytes.substr(0, length)};
+        rs_bit_vector loaded_bits;
+        compact_vector loaded_values;
+        ASSERT_THROW(
+            {
+                loaded_bits.load(is);
+                loaded_values.load(is);
+            },
+            exception);
+
+        unseekable_buf buf{bytes.substr(0, length)};
+        std::istream unseekable{&buf};
+        ASSERT_THROW(
+            {
+                loaded_bits.load(unseekable);
+                loaded_values.load(unseekable);
+            },
+            exception);
+    }
+
+    // The corrupted length of the words is refused before allocating them.
+    std::string corrupted = bytes;
+    const uint64_t huge = UINT64_MAX / 16;
+    std::memcpy(corrupted.data() + sizeof(uint64_t), &huge, sizeof(huge));
+    {
+        std::stringstream is{corrupted};
+        rs_bit_vector loaded_bits;
+        ASSERT_THROW(loaded_bits.load(is), exception);
+    }
+    {
+        unseekable_buf buf{corrupted};
+        std::istream unseekable{&buf};
+        rs_bit_vector loaded_bits;
+        ASSERT_THROW(loaded_bits.load(unseekable), exception);
+    }
+
+    // The size disagreeing with the words is refused.
+    std::string inconsistent = bytes;
+    const uint64_t size = N * 2;
+    std::memcpy(inconsistent.data(), &size, sizeof(size));
+    std::stringstream is{inconsistent};
+    rs_bit_vector loaded_bits;
+    ASSERT_THROW(loaded_bits.load(is), exception);
+}
+
 }  // namespace
\ No newline at end of file
@@ -0,0 +1,117 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <poplar.hpp>
+
+#include "test_common.hpp"
+
+namespace {
+
+using namespace poplar;
+using namespace poplar::test;
+
+// The blob of the i-th key is the key repeated i % 4 times, so some blobs are empty.
+std::string make_blob(const std::string& key, uint64_t i) {
+    std::string blob;
+    for (uint64_t j = 0; j < i % 4; ++j) {
+        blob += key;
+    }
+    return blob;
+}
+
+std::string to_string(char_range blob) {
+    return {reinterpret_cast<const char*>(blob.begin), blob.length()};
+}
+
+template <typename Map>
+void insert_blobs(Map& map, const std::vector<std::string>& keys, uint64_t shift) {
+    for (uint64_t i = 0; i < keys.size(); i += 2) {
+        map.update(keys[i], make_blob(keys[i], i + shift));
+    }
+}
+
+template <typename Map>
+void search_blobs(const Map& map, const std::vector<std::string>& keys, uint64_t shift) {
+    for (uint64_t i = 0; i < keys.size(); i += 2) {
+        auto blob = map.find(keys[i]);
+        ASSERT_NE(blob.begin, nullptr);
+        ASSERT_EQ(to_string(blob), make_blob(keys[i], i + shift));
+    }
+    for (uint64_t i = 1; i < keys.size(); i += 2) {
+        ASSERT_EQ(map.find(keys[i]).begin, nullptr);
+    }
+}
+
+}  // namespace
+
+template <class>
+class blob_map_test : public ::testing::Test {};
+
+using blob_map_types = ::testing::Types<blob_map<plain_bonsai_map<uint64_t>>, blob_map<compact_bonsai_map<uint32_t>>,
+                                        blob_map<plain_fkhash_map<uint64_t>>, blob_map<compact_fkhash_map<uint32_t>>>;
+
+TYPED_TEST_SUITE(blob_map_test, blob_map_types);
+
+TYPED_TEST(blob_map_test, Tiny) {
+    auto keys = make_tiny_keys();
+    TypeParam map;
+    insert_blobs(map, keys, 0);
+    search_blobs(map, keys, 0);
+    ASSERT_EQ(map.size(), (keys.size() + 1) / 2);
+}
+
+TYPED_TEST(blob_map_test, Overwrite) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    TypeParam map;
+    insert_blobs(map, keys, 0);
+
+    for (uint64_t shift = 1; shift <= 8; ++shift) {
+        insert_blobs(map, keys, shift);
+        search_blobs(map, keys, shift);
+        // The log is compacted before the dead bytes exceed the live ones.
+        ASSERT_LE(map.dead_bytes(), map.log_bytes() / 2 + TypeParam::min_compaction_bytes);
+    }
+
+    map.compact();
+    ASSERT_EQ(map.dead_bytes(), 0);
+    search_blobs(map, keys, 8);
+
+    uint64_t num_keys = 0, blob_bytes = 0;
+    map.enumerate([&](std::string_view key, char_range blob) {
+        ASSERT_NE(map.find(std::string{key}).begin, nullptr);
+        ++num_keys;
+        blob_bytes += vbyte::size(blob.length()) + blob.length();
+    });
+    ASSERT_EQ(num_keys, map.size());
+    ASSERT_EQ(blob_bytes, map.log_bytes());
+}
+
+TEST(blob_map_test, OffsetOverflow) {
+    blob_map<plain_bonsai_map<uint8_t>> map;
+    const std::string blob(300, 'x');
+    map.update("a", blob);
+    ASSERT_THROW(map.update("b", blob), poplar::exception);
+}
@@ -0,0 +1,148 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <poplar.hpp>
+#include <thread>
+
+#include "test_common.hpp"
+
+namespace {
+
+using namespace poplar;
+using namespace poplar::test;
+
+constexpr uint64_t num_threads = 4;
+
+}  // namespace
+
+template <class>
+class concurrent_counter_test : public ::testing::Test {};
+
+using concurrent_counter_types =
+    ::testing::Types<concurrent_counter<plain_bonsai_trie<>, plain_bonsai_nlm<no_value>>,
+                     concurrent_counter<compact_bonsai_trie<>, compact_bonsai_nlm<no_value>, uint32_t>,
+                     concurrent_counter<plain_fkhash_trie<>, plain_fkhash_nlm<no_value>>,
+                     concurrent_counter<compact_fkhash_trie<>, compact_fkhash_nlm<no_value>, uint32_t>>;
+
+TYPED_TEST_SUITE(concurrent_counter_test, concurrent_counter_types);
+
+TYPED_TEST(concurrent_counter_test, Words) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    TypeParam counter;
+
+    // The i-th thread adds 1 for every key and i + 1 for every num_threads-th key from the i-th.
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            for (uint64_t i = 0; i < keys.size(); ++i) {
+                counter.add(keys[(i + t * 997) % keys.size()]);
+            }
+            for (uint64_t i = t; i < keys.size(); i += num_threads) {
+                counter.add(keys[i], static_cast<typename TypeParam::counter_type>(t + 1));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(counter.size(), keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(counter.get(keys[i]), num_threads + i % num_threads + 1);
+    }
+    ASSERT_EQ(counter.get("not registered"), 0);
+
+    uint64_t num_keys = 0;
+    counter.enumerate([&](std::string_view, uint64_t count) {
+        ASSERT_GT(count, num_threads);
+        ++num_keys;
+    });
+    ASSERT_EQ(num_keys, keys.size());
+}
+
+TYPED_TEST(concurrent_counter_test, StablePointers) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    TypeParam counter;
+    counter.reserve(keys.size(), 10);
+
+    const uint64_t epoch = counter.epoch();
+    std::vector<typename TypeParam::counter_type*> ptrs;
+    for (const auto& key : keys) {
+        ptrs.push_back(counter.update(key));
+    }
+    ASSERT_EQ(counter.epoch(), epoch);
+
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        TypeParam::fetch_add(ptrs[i], static_cast<typename TypeParam::counter_type>(i));
+    }
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(counter.get(keys[i]), i);
+    }
+}
+
+TYPED_TEST(concurrent_counter_test, PointersWithinReservedCapacity) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    // The pointers may be used while new keys are inserted as long as they fit in the reserved capacity.
+    TypeParam counter;
+    counter.reserve(keys.size(), 10);
+    const uint64_t epoch = counter.epoch();
+
+    const uint64_t num_first = keys.size() / 2;
+    std::vector<typename TypeParam::counter_type*> ptrs;
+    for (uint64_t i = 0; i < num_first; ++i) {
+        ptrs.push_back(counter.update(keys[i]));
+    }
+
+    // The half of the threads increment the counters of the first keys through the pointers, and the others
+    // insert the rest of the keys.
+    std::vector<std::thread> threads;
+    for (uint64_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            if (t % 2 == 0) {
+                for (uint64_t i = 0; i < num_first; ++i) {
+                    TypeParam::fetch_add(ptrs[i], 1);
+                }
+            } else {
+                for (uint64_t i = num_first + t / 2; i < keys.size(); i += num_threads / 2) {
+                    counter.add(keys[i]);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(counter.epoch(), epoch);
+    ASSERT_EQ(counter.size(), keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(counter.get(keys[i]), i < num_first ? num_threads / 2 : 1);
+    }
+}
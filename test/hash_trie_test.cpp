@@ -129,7 +129,8 @@ template <typename>
 class hash_trie_test : public ::testing::Test {};
 
 using hash_trie_types =
-    ::testing::Types<plain_fkhash_trie<>, plain_bonsai_trie<>, compact_fkhash_trie<>, compact_bonsai_trie<>>;
+    ::testing::Types<plain_fkhash_trie<>, plain_bonsai_trie<>, compact_fkhash_trie<>, compact_bonsai_trie<>,
+                     plain_fkhash_trie<90, hash::vigna_hasher, 125>>;
 
 TYPED_TEST_CASE(hash_trie_test, hash_trie_types);
 
@@ -74,7 +74,14 @@ void search_keys(Map& map, const std::vector<std::string>& keys) {
 using map_types = ::testing::Types<plain_bonsai_map<value_type>,
                                    compact_bonsai_map<value_type>,
                                    plain_fkhash_map<value_type>,
-                                   compact_fkhash_map<value_type>
+                                   compact_fkhash_map<value_type>,
+                                   compact_bonsai_map<value_type, 16, nibble_length_coder>,
+                                   compact_fkhash_map<value_type, 16, fixed_length_coder>,
+                                   map<compact_bonsai_trie<>, value_array_nlm<compact_bonsai_nlm<no_value>, value_vector<value_type>>>,
+                                   map<plain_fkhash_trie<>, value_array_nlm<plain_fkhash_nlm<no_value>, packed_value_vector<40>>>,
+                                   map<compact_bonsai_trie<>, value_array_nlm<compact_bonsai_nlm<no_value>, slab_value_vector<value_type>>>,
+                                   map<compact_fkhash_trie<>, value_array_nlm<compact_fkhash_nlm<no_value>, slab_value_vector<value_type, 8>>>,
+                                   map<plain_fkhash_trie<90, hash::vigna_hasher, 125>, plain_fkhash_nlm<value_type>>
                                    >;
 // clang-format on
 
@@ -97,4 +104,383 @@ TYPED_TEST(map_test, Words) {
     search_keys(map, keys);
 }
 
+TYPED_TEST(map_test, Reserve) {
+    TypeParam map;
+    auto keys = load_keys("words.txt");
+    map.reserve(keys.size() / 2, 8);
+    insert_keys(map, keys);
+    search_keys(map, keys);
+
+    uint64_t capa_size = map.capa_size();
+    map.reserve(keys.size() * 4, 8);
+    ASSERT_LT(capa_size, map.capa_size());
+    search_keys(map, keys);
+
+    capa_size = map.capa_size();
+    map.reserve(1, 8);
+    ASSERT_EQ(capa_size, map.capa_size());
+    search_keys(map, keys);
+}
+
+TYPED_TEST(map_test, ShrinkToFit) {
+    TypeParam map;
+    auto keys = load_keys("words.txt");
+    map.reserve(keys.size() * 4, 8);
+    insert_keys(map, keys);
+
+    uint64_t capa_size = map.capa_size();
+    uint64_t alloc_bytes = map.alloc_bytes();
+    uint64_t reclaimed = map.shrink_to_fit();
+    ASSERT_GT(capa_size, map.capa_size());
+    ASSERT_LT(0, reclaimed);
+    ASSERT_EQ(alloc_bytes - reclaimed, map.alloc_bytes());
+    search_keys(map, keys);
+
+    for (uint64_t i = 1; i < keys.size(); i += 2) {
+        ASSERT_NE(map.update(make_char_range(keys[i])), nullptr);
+    }
+    ASSERT_EQ(map.size(), keys.size());
+}
+
+TEST(map_test, ValueArrayStrings) {
+    map<plain_bonsai_trie<>, value_array_nlm<plain_bonsai_nlm<no_value>, value_vector<std::string>>> map;
+    auto keys = load_keys("words.txt");
+
+    for (const auto& key : keys) {
+        *map.update(key) = key;
+    }
+    for (const auto& key : keys) {
+        auto ptr = map.find(key);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(*ptr, key);
+    }
+}
+
+TYPED_TEST(map_test, FrontCache) {
+    TypeParam map;
+    map.enable_cache(4);
+    auto keys = load_keys("words.txt");
+
+    // The cache is kept over the expansions while the other half is inserted.
+    for (uint64_t i = 0; i < keys.size(); i += 2) {
+        *map.update(make_char_range(keys[i])) = i;
+        ASSERT_EQ(*map.find(keys[i / 4 * 2]), i / 4 * 2);
+    }
+    search_keys(map, keys);
+    search_keys(map, keys);
+    ASSERT_LT(0, map.get_cache().num_hits());
+
+    // Only the first lookup of each key misses.
+    const uint64_t num_hits = map.get_cache().num_hits();
+    for (uint64_t i = 0; i < 100; ++i) {
+        ASSERT_EQ(*map.find(keys[i % 4 * 2]), i % 4 * 2);
+    }
+    ASSERT_LE(num_hits + 96, map.get_cache().num_hits());
+}
+
+TEST(map_test, FrontCacheSets) {
+    // Every set is used, so the cache holds more than the half of the entries.
+    front_cache cache{4};
+    auto keys = load_keys("words.txt");
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        cache.insert(front_cache::fingerprint(make_char_range(keys[i])), i, 0);
+    }
+    ASSERT_EQ(cache.num_entries(), 16 * front_cache::num_ways);
+
+    front_cache tiny{1};
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        tiny.insert(front_cache::fingerprint(make_char_range(keys[i])), i, 0);
+    }
+    ASSERT_EQ(tiny.num_entries(), 2 * front_cache::num_ways);
+}
+
+TYPED_TEST(map_test, LearnedCodes) {
+    auto keys = load_keys("words.txt");
+    const std::vector<std::string> sample(keys.begin(), keys.begin() + 10);
+
+    TypeParam map{0, 32, sample};
+    const uint32_t code_bits = map.code_bits();
+    ASSERT_GT(8, code_bits);
+
+    // The characters out of the sample widen the codes.
+    insert_keys(map, keys);
+    search_keys(map, keys);
+    ASSERT_LT(code_bits, map.code_bits());
+
+    TypeParam tiny{0, 32, make_tiny_keys()};
+    auto tiny_keys = make_tiny_keys();
+    insert_keys(tiny, tiny_keys);
+    search_keys(tiny, tiny_keys);
+    ASSERT_GT(8, tiny.code_bits());
+}
+
+TYPED_TEST(map_test, Merge) {
+    auto keys = load_keys("words.txt");
+    const uint64_t n = keys.size();
+
+    // The maps share the middle third of the keys, and the small lambda makes step nodes.
+    TypeParam map{0, 4}, other{0, 4};
+    for (uint64_t i = 0; i < n / 3 * 2; ++i) {
+        *map.update(keys[i]) = i;
+    }
+    for (uint64_t i = n / 3; i < n; ++i) {
+        *other.update(keys[i]) = i * 10;
+    }
+
+    map.merge(other, [](value_type& value, value_type other_value) { value += other_value; });
+    ASSERT_EQ(map.size(), n);
+    for (uint64_t i = 0; i < n; ++i) {
+        auto ptr = map.find(keys[i]);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(*ptr, i < n / 3 ? i : (n / 3 * 2 <= i ? i * 10 : i * 11));
+    }
+
+    TypeParam empty;
+    empty.merge(map);
+    ASSERT_EQ(empty.size(), n);
+    ASSERT_EQ(empty.lambda(), 4);
+    for (uint64_t i = 0; i < n; ++i) {
+        ASSERT_EQ(*empty.find(keys[i]), *map.find(keys[i]));
+    }
+
+    // The copied nodes work for the following insertions and the key IDs.
+    if constexpr (TypeParam::trie_type_id == trie_type_ids::FKHASH_TRIE) {
+        empty.enable_key_ids();
+    }
+    for (uint64_t i = 0; i < n; i += 2) {
+        *empty.update(keys[i] + "$") = i;
+    }
+    std::string key;
+    for (uint64_t i = 0; i < n; ++i) {
+        ASSERT_EQ(*empty.find(keys[i]), *map.find(keys[i]));
+        if constexpr (TypeParam::trie_type_id == trie_type_ids::FKHASH_TRIE) {
+            ASSERT_TRUE(empty.extract_key(empty.find_id(keys[i]), key));
+            ASSERT_EQ(key, keys[i]);
+        }
+        if (i % 2 == 0) {
+            ASSERT_EQ(*empty.find(keys[i] + "$"), i);
+        }
+    }
+
+    // The nodes are copied into a map of another trie.
+    compact_bonsai_map<value_type> bonsai;
+    plain_fkhash_map<value_type> fkhash;
+    bonsai.merge(map);
+    fkhash.merge(map);
+    for (uint64_t i = 0; i < n; ++i) {
+        ASSERT_EQ(*bonsai.find(keys[i]), *map.find(keys[i]));
+        ASSERT_EQ(*fkhash.find(keys[i]), *map.find(keys[i]));
+    }
+}
+
+// The keys over a few characters are often prefixes of the others, which makes the nodes reached by the
+// terminator and the branches at the ends of the labels.
+std::vector<std::string> make_branchy_keys(uint64_t num_keys, uint8_t num_chars, uint64_t seed) {
+    std::mt19937_64 engine(seed);
+    std::vector<std::string> keys(num_keys);
+    for (auto& key : keys) {
+        const uint64_t length = 1 + engine() % 24;
+        for (uint64_t i = 0; i < length; ++i) {
+            key.push_back(static_cast<char>('a' + engine() % num_chars));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::shuffle(keys.begin(), keys.end(), engine);
+    return keys;
+}
+
+template <typename Map, typename OtherMap>
+void test_merge_nodes(Map& map, OtherMap& other, const std::vector<std::string>& keys) {
+    // The first two thirds go to the map and the last two thirds to the other in another order.
+    const uint64_t n = keys.size();
+    for (uint64_t i = 0; i < n / 3 * 2; ++i) {
+        *map.update(keys[i]) = i;
+    }
+    for (uint64_t i = n; i > n / 3; --i) {
+        *other.update(keys[i - 1]) = (i - 1) * 10;
+    }
+
+    map.merge(other, [](value_type& value, value_type other_value) { value += other_value; });
+    ASSERT_EQ(map.size(), n);
+    for (uint64_t i = 0; i < n; ++i) {
+        auto ptr = map.find(keys[i]);
+        ASSERT_NE(ptr, nullptr) << keys[i];
+        ASSERT_EQ(*ptr, i < n / 3 ? i : (n / 3 * 2 <= i ? i * 10 : i * 11)) << keys[i];
+    }
+
+    uint64_t num_keys = 0;
+    map.enumerate([&](std::string_view, const value_type&) { ++num_keys; });
+    ASSERT_EQ(num_keys, n);
+
+    // The merged nodes work for the following insertions.
+    for (uint64_t i = 0; i < n; i += 3) {
+        *map.update(keys[i] + "z") = i;
+    }
+    for (uint64_t i = 0; i < n; i += 3) {
+        ASSERT_EQ(*map.find(keys[i] + "z"), i);
+    }
+}
+
+TYPED_TEST(map_test, MergeNodes) {
+    const auto keys = make_branchy_keys(20000, 3, 13);
+
+    // The lambdas of the maps differ, so the step nodes are made again.
+    for (auto [lambda, other_lambda] : {std::pair{2, 8}, std::pair{8, 2}, std::pair{4, 4}}) {
+        TypeParam map{0, uint64_t(lambda)}, other{0, uint64_t(other_lambda)};
+        test_merge_nodes(map, other, keys);
+    }
+    {
+        TypeParam map{0, 4};
+        compact_bonsai_map<value_type> bonsai{0, 16};
+        test_merge_nodes(map, bonsai, keys);
+    }
+    {
+        TypeParam map{0, 4};
+        plain_fkhash_map<value_type> fkhash{0, 2};
+        test_merge_nodes(map, fkhash, keys);
+    }
+
+    // The codes learned from the keys over two characters are widened for the characters of the other.
+    const auto wide_keys = make_branchy_keys(20000, 12, 17);
+    TypeParam map{0, 4, make_branchy_keys(100, 2, 19)};
+    const uint32_t code_bits = map.code_bits();
+    TypeParam other{0, 4};
+    test_merge_nodes(map, other, wide_keys);
+    ASSERT_LT(code_bits, map.code_bits());
+}
+
+TYPED_TEST(map_test, ExtractKey) {
+    if constexpr (TypeParam::trie_type_id == trie_type_ids::FKHASH_TRIE) {
+        auto keys = load_keys("words.txt");
+
+        // The small lambda makes step nodes, and the parents are kept from the middle of the insertion.
+        TypeParam map{0, 4};
+        for (uint64_t i = 0; i < keys.size() / 2; ++i) {
+            map.update(keys[i]);
+        }
+        map.enable_key_ids();
+        for (uint64_t i = keys.size() / 2; i < keys.size(); ++i) {
+            map.update(keys[i]);
+        }
+
+        // The IDs are dense and given in the insertion order, skipping the step nodes.
+        std::string key;
+        for (uint64_t i = 0; i < keys.size(); ++i) {
+            ASSERT_EQ(map.find_id(keys[i]), i);
+            ASSERT_TRUE(map.extract_key(i, key));
+            ASSERT_EQ(key, keys[i]);
+        }
+        ASSERT_EQ(map.find_id("not registered"), TypeParam::nil_id);
+        ASSERT_FALSE(map.extract_key(map.size(), key));
+
+        // The IDs are kept while the hash table is expanded and shrunk.
+        map.shrink_to_fit();
+        for (uint64_t i = 0; i < keys.size(); i += 7) {
+            ASSERT_EQ(map.find_id(keys[i]), i);
+        }
+
+        // The IDs are given from the first insertion.
+        TypeParam with_ids;
+        with_ids.enable_key_ids();
+        for (uint64_t i = 0; i < keys.size(); ++i) {
+            with_ids.update(keys[i]);
+        }
+        for (uint64_t i = 0; i < keys.size(); ++i) {
+            ASSERT_EQ(with_ids.find_id(keys[i]), i);
+            ASSERT_TRUE(with_ids.extract_key(i, key));
+            ASSERT_EQ(key, keys[i]);
+        }
+    }
+}
+
+TYPED_TEST(map_test, AutoLambda) {
+    auto keys = load_keys("words.txt");
+
+    // The largest lambda is too wide for the short labels of the words, so the map is rebuilt with another.
+    TypeParam map{0, TypeParam::max_auto_lambda};
+    if constexpr (TypeParam::nlm_type::stable_values) {
+        ASSERT_THROW(map.enable_auto_lambda(keys.size() / 4), exception);
+    } else {
+        map.enable_auto_lambda(keys.size() / 4);
+        insert_keys(map, keys);
+        search_keys(map, keys);
+        ASSERT_LE(1, map.num_lambda_tunes());
+        ASSERT_GT(TypeParam::max_auto_lambda, map.lambda());
+        ASSERT_LE(TypeParam::min_auto_lambda, map.lambda());
+        if constexpr (TypeParam::trie_type_id == trie_type_ids::FKHASH_TRIE) {
+            ASSERT_THROW(map.enable_key_ids(), exception);
+        }
+    }
+
+    TypeParam with_ids;
+    if constexpr (TypeParam::trie_type_id == trie_type_ids::FKHASH_TRIE) {
+        with_ids.enable_key_ids();
+        ASSERT_THROW(with_ids.enable_auto_lambda(), exception);
+    }
+
+    const std::vector<std::string> sample(keys.begin(), keys.begin() + keys.size() / 10);
+    TypeParam tuned{0, TypeParam::max_auto_lambda};
+    tuned.tune_lambda(sample);
+    ASSERT_GT(TypeParam::max_auto_lambda, tuned.lambda());
+    insert_keys(tuned, keys);
+    search_keys(tuned, keys);
+
+    // The values are kept when the filled map is rebuilt.
+    TypeParam filled{0, TypeParam::max_auto_lambda};
+    insert_keys(filled, keys);
+    if constexpr (TypeParam::nlm_type::stable_values) {
+        ASSERT_THROW(filled.tune_lambda(sample), exception);
+    } else {
+        filled.tune_lambda(sample);
+        ASSERT_EQ(tuned.lambda(), filled.lambda());
+        search_keys(filled, keys);
+    }
+
+    if constexpr (TypeParam::trie_type_id == trie_type_ids::FKHASH_TRIE) {
+        with_ids.tune_lambda(sample);  // allowed while empty
+        insert_keys(with_ids, keys);
+        ASSERT_THROW(with_ids.tune_lambda(sample), exception);
+    }
+}
+
+template <typename>
+class stable_map_test : public ::testing::Test {};
+
+// clang-format off
+using stable_map_types = ::testing::Types<
+    map<plain_bonsai_trie<>, value_array_nlm<plain_bonsai_nlm<no_value>, slab_value_vector<std::string>>>,
+    map<compact_bonsai_trie<>, value_array_nlm<compact_bonsai_nlm<no_value>, slab_value_vector<std::string>>>,
+    map<plain_fkhash_trie<>, value_array_nlm<plain_fkhash_nlm<no_value>, slab_value_vector<std::string>>>,
+    map<compact_fkhash_trie<>, value_array_nlm<compact_fkhash_nlm<no_value>, slab_value_vector<std::string>>>
+    >;
+// clang-format on
+
+TYPED_TEST_CASE(stable_map_test, stable_map_types);
+
+TYPED_TEST(stable_map_test, PointersSurviveExpansion) {
+    TypeParam map;
+    auto keys = load_keys("words.txt");
+
+    std::vector<std::string*> ptrs;
+    for (const auto& key : keys) {
+        ptrs.push_back(map.update(key));
+        *ptrs.back() = key;
+    }
+    ASSERT_LT(TypeParam::min_capa_bits, bit_tools::ceil_log2(map.capa_size()));
+
+    map.shrink_to_fit();
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(*ptrs[i], keys[i]);
+        ASSERT_EQ(map.find(keys[i]), ptrs[i]);
+    }
+}
+
+TEST(map_test, PackedValueOverflow) {
+    map<compact_fkhash_trie<>, value_array_nlm<compact_fkhash_nlm<no_value>, packed_value_vector<4>>> map;
+    *map.update("key") = 15;
+    ASSERT_EQ(*map.find("key"), 15);
+    ASSERT_THROW(*map.update("key") = 16, exception);
+}
+
 }  // namespace
@@ -0,0 +1,72 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <poplar.hpp>
+#include <numeric>
+#include <random>
+
+namespace {
+
+using namespace poplar;
+
+TEST(nlm_test, CompactBonsaiResize) {
+    constexpr uint64_t chunk_size = 16;
+    using nlm_type = compact_bonsai_nlm<uint64_t, chunk_size>;
+
+    nlm_type nlm(16);
+    std::vector<uint64_t> pos_map(1ULL << 16, UINT64_MAX);
+
+    // The records are scattered over the new table so that each new chunk gathers them from several old chunks
+    // out of order.
+    std::vector<uint64_t> new_positions(1ULL << 17);
+    std::iota(new_positions.begin(), new_positions.end(), 0);
+    std::shuffle(new_positions.begin(), new_positions.end(), std::mt19937_64{13});
+
+    uint64_t max_label_length = 0;
+    for (uint64_t pos = 1; pos < pos_map.size(); pos += 2) {
+        const std::string label = std::to_string(pos * 7);
+        *nlm.insert(pos, make_char_range(label)) = pos;
+        pos_map[pos] = new_positions[pos];
+        max_label_length = std::max<uint64_t>(max_label_length, label.size());
+    }
+
+    const uint64_t old_bytes = nlm.alloc_bytes();
+    nlm.resize(pos_map, 17);
+
+    // Each old chunk is released after its records are moved, so the labels are not held twice and the extra
+    // space is about the arrays of the new table plus an old chunk.
+    const uint64_t max_chunk_bytes = chunk_size * (1 + max_label_length + sizeof(uint64_t));
+    const uint64_t label_bytes = old_bytes - nlm_type::estimate_alloc_bytes(16, 0, 0);
+    ASSERT_LE(nlm.resize_extra_bytes(), nlm_type::estimate_alloc_bytes(17, 0, 0) + max_chunk_bytes);
+    ASSERT_LT(nlm.resize_extra_bytes(), label_bytes);
+
+    for (uint64_t pos = 1; pos < pos_map.size(); pos += 2) {
+        const std::string label = std::to_string(pos * 7);
+        auto [vptr, match] = nlm.compare(new_positions[pos], make_char_range(label));
+        ASSERT_NE(vptr, nullptr);
+        ASSERT_EQ(*vptr, pos);
+    }
+}
+
+}  // namespace
@@ -0,0 +1,84 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <poplar.hpp>
+
+#include "test_common.hpp"
+
+namespace {
+
+using namespace poplar;
+using namespace poplar::test;
+
+}  // namespace
+
+template <class>
+class partitioned_map_test : public ::testing::Test {};
+
+using partitioned_map_types =
+    ::testing::Types<partitioned_map<plain_bonsai_map<uint64_t>>, partitioned_map<compact_bonsai_map<uint64_t>>,
+                     partitioned_map<plain_fkhash_map<uint64_t>>, partitioned_map<compact_fkhash_map<uint64_t>>>;
+
+TYPED_TEST_SUITE(partitioned_map_test, partitioned_map_types);
+
+TYPED_TEST(partitioned_map_test, ParallelBuild) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    std::vector<uint64_t> values(keys.size());
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        values[i] = i;
+    }
+
+    auto map = TypeParam::parallel_build(keys, values, 4);
+    ASSERT_EQ(map.num_parts(), 16);
+    ASSERT_EQ(map.size(), keys.size());
+
+    for (uint64_t i = 0; i < keys.size(); ++i) {
+        auto ptr = map.find(keys[i]);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(*ptr, i);
+    }
+    ASSERT_EQ(map.find("not registered"), nullptr);
+
+    *map.update("not registered") = keys.size();
+    ASSERT_EQ(*map.find("not registered"), keys.size());
+    ASSERT_EQ(map.size(), keys.size() + 1);
+
+    uint64_t num_keys = 0;
+    map.enumerate([&](std::string_view, uint64_t) { ++num_keys; });
+    ASSERT_EQ(num_keys, keys.size() + 1);
+}
+
+TYPED_TEST(partitioned_map_test, SinglePart) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    auto map = TypeParam::parallel_build(keys, 2, 1);
+    ASSERT_EQ(map.num_parts(), 1);
+    ASSERT_EQ(map.size(), keys.size());
+    for (const auto& key : keys) {
+        ASSERT_NE(map.find(key), nullptr);
+    }
+}
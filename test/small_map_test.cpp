@@ -0,0 +1,101 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <poplar.hpp>
+
+#include "test_common.hpp"
+
+namespace {
+
+using namespace poplar;
+using namespace poplar::test;
+
+using value_type = uint64_t;
+
+template <typename Map>
+void insert_keys(Map& map, const std::vector<std::string>& keys) {
+    for (uint64_t i = 0; i < keys.size(); i += 2) {
+        auto ptr = map.update(keys[i]);
+        ASSERT_EQ(*ptr, 0);
+        *ptr = i + 1;
+    }
+}
+
+template <typename Map>
+void search_keys(const Map& map, const std::vector<std::string>& keys) {
+    for (uint64_t i = 0; i < keys.size(); i += 2) {
+        auto ptr = map.find(keys[i]);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(*ptr, i + 1);
+    }
+    for (uint64_t i = 1; i < keys.size(); i += 2) {
+        ASSERT_EQ(map.find(keys[i]), nullptr);
+    }
+
+    uint64_t num_keys = 0;
+    map.enumerate([&](std::string_view key, const value_type& value) {
+        ASSERT_EQ(keys[value - 1], key);
+        ++num_keys;
+    });
+    ASSERT_EQ(num_keys, map.size());
+}
+
+}  // namespace
+
+template <class>
+class small_map_test : public ::testing::Test {};
+
+using small_map_types = ::testing::Types<small_map<plain_bonsai_map<value_type>>,
+                                         small_map<compact_bonsai_map<value_type>, 16>,
+                                         small_map<plain_fkhash_map<value_type>, 1000>,
+                                         small_map<compact_fkhash_map<value_type>>>;
+
+TYPED_TEST_SUITE(small_map_test, small_map_types);
+
+TYPED_TEST(small_map_test, Tiny) {
+    auto keys = make_tiny_keys();
+    TypeParam map;
+    insert_keys(map, keys);
+    search_keys(map, keys);
+    ASSERT_TRUE(map.is_small());
+    ASSERT_GT(1024, map.alloc_bytes());
+}
+
+TYPED_TEST(small_map_test, Words) {
+    auto keys = load_keys("words.txt");
+    ASSERT_FALSE(keys.empty());
+
+    TypeParam map;
+    for (uint64_t i = 0; i < keys.size(); i += 2) {
+        *map.update(keys[i]) = i + 1;
+        if (i / 2 == TypeParam::max_small_size) {
+            // The keys are moved to the map by this insertion.
+            ASSERT_FALSE(map.is_small());
+        } else if (i / 2 < TypeParam::max_small_size) {
+            ASSERT_TRUE(map.is_small());
+        }
+    }
+    search_keys(map, keys);
+    ASSERT_EQ(map.size(), map.get_map()->size());
+}
@@ -0,0 +1,81 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018–2019 Shunsuke Kanda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <poplar.hpp>
+#include <random>
+
+namespace {
+
+using namespace poplar;
+
+std::vector<uint64_t> make_values() {
+    std::vector<uint64_t> vals = {0, 1, 127, 128, 16383, 16384, UINT32_MAX, UINT64_MAX};
+    std::mt19937_64 engine(13);
+    for (uint64_t i = 0; i < 1000; ++i) {
+        vals.push_back(engine() >> (engine() % 64));
+    }
+    return vals;
+}
+
+TEST(vbyte_test, RoundTrip) {
+    auto vals = make_values();
+
+    std::vector<uint8_t> codes;
+    for (uint64_t val : vals) {
+        const uint64_t n = vbyte::append(codes, val);
+        ASSERT_EQ(n, vbyte::size(val));
+
+        uint8_t buf[10];
+        ASSERT_EQ(vbyte::encode(buf, val), n);
+        ASSERT_TRUE(std::equal(buf, buf + n, codes.end() - n));
+    }
+
+    const uint8_t* ptr = codes.data();
+    for (uint64_t val : vals) {
+        uint64_t decoded = 0;
+        ptr += vbyte::decode(ptr, decoded);
+        ASSERT_EQ(decoded, val);
+    }
+    ASSERT_EQ(ptr, codes.data() + codes.size());
+}
+
+TEST(vbyte_test, Skip) {
+    const std::vector<uint64_t> lengths = {0, 3, 127, 128, 300, 1, 0, 200};
+
+    // Records of vbyte(length) followed by length bytes
+    std::vector<uint8_t> codes;
+    std::vector<uint64_t> offsets;
+    for (uint64_t length : lengths) {
+        offsets.push_back(codes.size());
+        vbyte::append(codes, length);
+        codes.insert(codes.end(), length, 0xFF);
+    }
+    offsets.push_back(codes.size());
+
+    for (uint64_t n = 0; n <= lengths.size(); ++n) {
+        ASSERT_EQ(vbyte::skip(codes.data(), n), codes.data() + offsets[n]);
+    }
+}
+
+}  // namespace